@@ -0,0 +1,446 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <type_traits>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Generic LRU cache that allocates everything in its constructor:
+// * all the entries live in one contiguous slab, and the recency list is threaded
+//   through them with 32-bit indices instead of pointers;
+// * the key index is an open-addressing (linear probing) table of 32-bit slab
+//   indices, so a lookup touches a couple of cache lines instead of chasing the
+//   nodes of a tree or of a bucket list.
+// Once the cache is built, get and put never call the allocator (as long as
+// copying K and V does not).
+//
+// Slab LRU cache of p146v4_lru_cache_slab.cpp, plus a snapshot file to warm up
+// a new process: save writes the entries in recency order, and load maps the
+// file and rebuilds the slab, the recency links and the index in one linear
+// pass, without going through put.
+//
+// Snapshot layout (native endianness, so only for the same architecture):
+//   SnapshotHeader, then size x { K key; V value; } from LRU to MRU.
+template <typename K, typename V, typename Hash = hash<K>>
+class LRUCache {
+    static_assert(is_trivially_copyable<K>::value && is_trivially_copyable<V>::value,
+                  "snapshots store keys and values as raw bytes");
+
+public:
+    LRUCache(int capacity) : _capacity(capacity), _size(0), _head(NIL), _tail(NIL) {
+        assert(capacity >= 0);
+        _nodes.resize(capacity);
+
+        // Keep the load factor at or below 50% so that probe sequences stay short.
+        size_t numSlots = 1;
+        while (numSlots < 2 * static_cast<size_t>(capacity)) {
+            numSlots <<= 1;
+        }
+        _slots.assign(numSlots, NIL);
+        _mask = numSlots - 1;
+    }
+
+    // Returns true and sets value if the key is in the cache.
+    bool get(K const & key, V& value) {
+        uint32_t slot = _findSlot(key);
+        uint32_t idx = _slots[slot];
+        if (idx == NIL) {
+            // Key not in the cache.
+            return false;
+        }
+
+        _reEnqueue(idx);
+        value = _nodes[idx].value;
+        return true;
+    }
+
+    void put(K const & key, V const & value) {
+        if (_capacity == 0) {
+            return;
+        }
+
+        uint32_t slot = _findSlot(key);
+        uint32_t idx = _slots[slot];
+        if (idx != NIL) {
+            // Existing key: update the value and move it to the back of the queue.
+            _nodes[idx].value = value;
+            _reEnqueue(idx);
+            return;
+        }
+
+        if (_size == _capacity) {
+            // Recycle the least recently used entry.
+            idx = _head;
+            _unlink(idx);
+            _eraseSlot(_findSlot(_nodes[idx].key));
+
+            // Erasing may have shifted the entries after it: look the slot up again.
+            slot = _findSlot(key);
+        } else {
+            idx = _size++;
+        }
+
+        _nodes[idx].key = key;
+        _nodes[idx].value = value;
+        _pushBack(idx);
+        _slots[slot] = idx;
+    }
+
+    // Writes all the entries, least recently used first. Throws on I/O errors.
+    void save(string const & path) const {
+        FILE* f = fopen(path.c_str(), "wb");
+        if (f == nullptr) {
+            throw runtime_error("Cannot open " + path + " for writing");
+        }
+
+        SnapshotHeader header;
+        memcpy(header.magic, MAGIC, sizeof(header.magic));
+        header.keySize = sizeof(K);
+        header.valueSize = sizeof(V);
+        header.capacity = _capacity;
+        header.size = _size;
+        bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+
+        // Buffer the records: one fwrite per entry would dominate the save time.
+        vector<Record> buffer;
+        buffer.reserve(min<size_t>(_size, 1 << 16));
+        for (uint32_t idx = _head; ok && idx != NIL; idx = _nodes[idx].next) {
+            buffer.push_back(Record{_nodes[idx].key, _nodes[idx].value});
+            if (buffer.size() == buffer.capacity() || _nodes[idx].next == NIL) {
+                ok = fwrite(buffer.data(), sizeof(Record), buffer.size(), f) == buffer.size();
+                buffer.clear();
+            }
+        }
+
+        if (fclose(f) != 0 || !ok) {
+            throw runtime_error("Cannot write " + path);
+        }
+    }
+
+    // Builds a cache from a snapshot written by save. The capacity is the one of
+    // the saved cache unless a larger one is given. Throws if the file cannot be
+    // read or is not a valid snapshot for these K and V.
+    static LRUCache load(string const & path, int capacity = 0) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw runtime_error("Cannot open " + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(SnapshotHeader))) {
+            close(fd);
+            throw runtime_error(path + " is not an LRUCache snapshot");
+        }
+        size_t length = st.st_size;
+        void* data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            throw runtime_error("Cannot map " + path);
+        }
+        // The file is read once, front to back.
+        madvise(data, length, MADV_SEQUENTIAL);
+
+        // Every field is checked before it is used: the capacity must fit in the
+        // int of the constructor, the records must fit in the allocated slab, and
+        // the record count is compared by division so that it cannot overflow.
+        // A negative capacity asks for nothing more than the saved one (as
+        // uint64_t, it would let any size through).
+        capacity = max(capacity, 0);
+        SnapshotHeader const * header = static_cast<SnapshotHeader const *>(data);
+        if (memcmp(header->magic, MAGIC, sizeof(header->magic)) != 0
+            || header->keySize != sizeof(K) || header->valueSize != sizeof(V)
+            || header->capacity > static_cast<uint64_t>(numeric_limits<int>::max())
+            || header->size > max<uint64_t>(capacity, header->capacity)
+            || header->size > (length - sizeof(SnapshotHeader)) / sizeof(Record)
+            || length != sizeof(SnapshotHeader) + header->size * sizeof(Record)) {
+            munmap(data, length);
+            throw runtime_error(path + " is not a valid snapshot for this cache");
+        }
+
+        LRUCache cache(max(capacity, static_cast<int>(header->capacity)));
+        Record const * records = reinterpret_cast<Record const *>(header + 1);
+        bool ok = cache._rebuild(records, header->size);
+        munmap(data, length);
+        if (!ok) {
+            throw runtime_error(path + " contains duplicate keys");
+        }
+        return cache;
+    }
+
+    int size() const {
+        return _size;
+    }
+
+    void printQueue() {
+        cout << "Queue:" << endl;
+        string out = " <[ ";
+        for (uint32_t idx = _head; idx != NIL; idx = _nodes[idx].next) {
+            out.append("(" + to_string(_nodes[idx].key) + ", " + to_string(_nodes[idx].value) + ") ");
+        }
+        out += "]<";
+        cout << out << endl;
+    }
+
+private:
+    static constexpr uint32_t NIL = 0xFFFFFFFFu;
+    static constexpr char MAGIC[8] = {'L', 'R', 'U', 'S', 'N', 'A', 'P', '1'};
+
+    struct SnapshotHeader {
+        char magic[8];
+        uint32_t keySize;
+        uint32_t valueSize;
+        uint64_t capacity;
+        uint64_t size;
+    };
+
+    struct Record {
+        K key;
+        V value;
+    };
+
+    // Records are already in recency order: entry i simply links to i - 1 and
+    // i + 1, and only the index needs a lookup per key.
+    bool _rebuild(Record const * records, size_t n) {
+        // Index inserts land on random slots: prefetch a few records ahead so
+        // that their misses overlap.
+        const size_t AHEAD = 16;
+        for (size_t i = 0; i < n; ++i) {
+            if (i + AHEAD < n) {
+                __builtin_prefetch(&_slots[_home(records[i + AHEAD].key)], 1);
+            }
+            uint32_t slot = _findSlot(records[i].key);
+            if (_slots[slot] != NIL) {
+                return false;
+            }
+            Node& node = _nodes[i];
+            node.key = records[i].key;
+            node.value = records[i].value;
+            node.prev = i == 0 ? NIL : i - 1;
+            node.next = i + 1 == n ? NIL : i + 1;
+            _slots[slot] = i;
+        }
+        _size = n;
+        _head = n == 0 ? NIL : 0;
+        _tail = n == 0 ? NIL : n - 1;
+        return true;
+    }
+
+    struct Node {
+        K key;
+        V value;
+        uint32_t prev;
+        uint32_t next;
+    };
+
+    size_t _home(K const & key) const {
+        // Fibonacci hashing: spreads poor hashes (e.g. the identity for integers)
+        // over the whole table.
+        uint64_t h = static_cast<uint64_t>(_hash(key)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(h >> 32) & _mask;
+    }
+
+    // Returns the slot holding the key, or the empty slot where it would go.
+    uint32_t _findSlot(K const & key) const {
+        size_t slot = _home(key);
+        while (_slots[slot] != NIL && !(_nodes[_slots[slot]].key == key)) {
+            slot = (slot + 1) & _mask;
+        }
+        return static_cast<uint32_t>(slot);
+    }
+
+    // Backward-shift deletion: pull later entries of the probe sequence into the
+    // hole, so that lookups never need tombstones.
+    void _eraseSlot(size_t hole) {
+        size_t slot = hole;
+        while (true) {
+            slot = (slot + 1) & _mask;
+            uint32_t idx = _slots[slot];
+            if (idx == NIL) {
+                break;
+            }
+            // The entry may move into the hole only if its home is not in (hole, slot].
+            size_t home = _home(_nodes[idx].key);
+            if (((slot - home) & _mask) >= ((slot - hole) & _mask)) {
+                _slots[hole] = idx;
+                hole = slot;
+            }
+        }
+        _slots[hole] = NIL;
+    }
+
+    void _unlink(uint32_t idx) {
+        Node& n = _nodes[idx];
+        if (n.prev != NIL) {
+            _nodes[n.prev].next = n.next;
+        } else {
+            _head = n.next;
+        }
+        if (n.next != NIL) {
+            _nodes[n.next].prev = n.prev;
+        } else {
+            _tail = n.prev;
+        }
+    }
+
+    void _pushBack(uint32_t idx) {
+        Node& n = _nodes[idx];
+        n.prev = _tail;
+        n.next = NIL;
+        if (_tail != NIL) {
+            _nodes[_tail].next = idx;
+        } else {
+            _head = idx;
+        }
+        _tail = idx;
+    }
+
+    void _reEnqueue(uint32_t idx) {
+        // Ensure the entry is at the back of the queue.
+        if (idx != _tail) {
+            _unlink(idx);
+            _pushBack(idx);
+        }
+    }
+
+    int _capacity;
+    int _size;
+
+    // Front (least recently used) and back (most recently used) of the queue.
+    uint32_t _head;
+    uint32_t _tail;
+
+    vector<Node> _nodes;
+    vector<uint32_t> _slots;
+    size_t _mask;
+    Hash _hash;
+};
+
+struct XorShift {
+    uint64_t s;
+    XorShift(uint64_t seed) : s(seed) {}
+    uint64_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+int main(int argc, char** argv) {
+    string path = argc > 1 ? argv[1] : "/tmp/p146v10_lru_cache.snapshot";
+
+    int capacity = 3;
+    LRUCache<int, int>* cache = new LRUCache<int, int>(capacity);
+    int value;
+    cache->put(1, 1);
+    cache->put(2, 2);
+    cache->put(3, 3);
+    cache->get(1, value);
+    cache->printQueue();
+    cout << "cache->save(" << path << ")" << endl;
+    cache->save(path);
+    delete cache;
+
+    LRUCache<int, int> loaded = LRUCache<int, int>::load(path);
+    cout << "LRUCache::load(" << path << ")" << endl;
+    loaded.printQueue();
+    // Same recency order: 2 is still the next one to go.
+    loaded.put(4, 4);
+    assert(!loaded.get(2, value));
+    assert(loaded.get(1, value) && value == 1);
+    // A negative capacity loads the saved one.
+    LRUCache<int, int> clamped = LRUCache<int, int>::load(path, -1);
+    assert(clamped.size() == loaded.size());
+
+    // Crafted headers are rejected: a capacity that does not fit in an int (it
+    // would be truncated to a small slab), more records than the capacity (also
+    // when load is given a negative capacity), and a record count whose byte size
+    // overflows. Each case is {header capacity, header size, load capacity}.
+    struct RawHeader {
+        char magic[8];
+        uint32_t keySize;
+        uint32_t valueSize;
+        uint64_t capacity;
+        uint64_t size;
+    };
+    int64_t const crafted[][3] = {
+        {(1ll << 32) + 1, 3, 0},
+        {2, 3, 0},
+        {2, 3, -1},
+        {3, (1ll << 60) + 3, 0},
+    };
+    for (int64_t const * c : crafted) {
+        RawHeader raw = {{'L', 'R', 'U', 'S', 'N', 'A', 'P', '1'}, sizeof(int), sizeof(int),
+                         static_cast<uint64_t>(c[0]), static_cast<uint64_t>(c[1])};
+        int records[6] = {1, 1, 2, 2, 3, 3};
+        FILE* f = fopen(path.c_str(), "wb");
+        fwrite(&raw, sizeof(raw), 1, f);
+        fwrite(records, sizeof(records), 1, f);
+        fclose(f);
+        bool rejected = false;
+        try {
+            LRUCache<int, int>::load(path, static_cast<int>(c[2]));
+        } catch (runtime_error const &) {
+            rejected = true;
+        }
+        assert(rejected);
+    }
+    cout << "Crafted snapshots rejected." << endl;
+    cout << endl;
+
+    // Warm restart of a large cache.
+    int bigCapacity = 10000000;
+    LRUCache<int, int> big(bigCapacity);
+    XorShift rng(1);
+    for (int i = 0; i < bigCapacity; ++i) {
+        big.put(static_cast<int>(rng.next() >> 33), i);
+    }
+    // Shuffle the recency order a bit.
+    for (int i = 0; i < bigCapacity / 10; ++i) {
+        big.get(static_cast<int>(rng.next() >> 33), value);
+    }
+
+    auto start = chrono::steady_clock::now();
+    big.save(path);
+    auto end = chrono::steady_clock::now();
+    cout << "saved " << big.size() << " entries in "
+         << chrono::duration<double, milli>(end - start).count() << " ms" << endl;
+
+    start = chrono::steady_clock::now();
+    LRUCache<int, int> reloaded = LRUCache<int, int>::load(path);
+    end = chrono::steady_clock::now();
+    cout << "loaded " << reloaded.size() << " entries in "
+         << chrono::duration<double, milli>(end - start).count() << " ms" << endl;
+
+    // Both caches must evict the same keys in the same order.
+    assert(reloaded.size() == big.size());
+    for (int i = 0; i < 1000; ++i) {
+        int key = -1 - i;
+        big.put(key, i);
+        reloaded.put(key, i);
+    }
+    XorShift check(1);
+    for (int i = 0; i < bigCapacity; ++i) {
+        int key = static_cast<int>(check.next() >> 33);
+        int a = -1;
+        int b = -1;
+        bool inBig = big.get(key, a);
+        bool inReloaded = reloaded.get(key, b);
+        assert(inBig == inReloaded && a == b);
+    }
+    remove(path.c_str());
+    return 0;
+}
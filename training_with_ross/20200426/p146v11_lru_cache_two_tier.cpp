@@ -0,0 +1,517 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// O(1) LRU cache from p146v2_lru_cache.cpp. Not thread-safe on its own.
+class LRUCache {
+public:
+    LRUCache(int capacity) : _capacity(capacity) {
+        _m.reserve(capacity);
+    }
+
+    void put(int key, int value) {
+        if (_capacity <= 0) {
+            return;
+        }
+
+        unordered_map<int, list<pair<int, int>>::iterator>::iterator it = _m.find(key);
+        if (it != _m.end()) {
+            it->second->second = value;
+            _reEnqueue(it->second);
+            return;
+        }
+
+        if (_m.size() == _capacity) {
+            list<pair<int, int>>::iterator lru = _q.begin();
+            _m.erase(lru->first);
+            lru->first = key;
+            lru->second = value;
+            _reEnqueue(lru);
+            _m[key] = lru;
+        } else {
+            _q.emplace_back(key, value);
+            _m[key] = prev(_q.end());
+        }
+    }
+
+    int get(int key) {
+        unordered_map<int, list<pair<int, int>>::iterator>::iterator it = _m.find(key);
+        if (it == _m.end()) {
+            return -1;
+        }
+
+        _reEnqueue(it->second);
+        return it->second->second;
+    }
+
+private:
+    void _reEnqueue(list<pair<int, int>>::iterator it) {
+        _q.splice(_q.end(), _q, it);
+    }
+
+    int _capacity;
+    list<pair<int, int>> _q;
+    unordered_map<int, list<pair<int, int>>::iterator> _m;
+};
+
+// Sharded LRU cache of p146v3_lru_cache_sharded.cpp: the shared L2.
+class ShardedLRUCache {
+public:
+    ShardedLRUCache(int capacity, int numShards = 16) : _numShards(numShards) {
+        _shards.reserve(numShards);
+        for (int i = 0; i < numShards; ++i) {
+            int slice = capacity / numShards + (i < capacity % numShards ? 1 : 0);
+            _shards.emplace_back(new Shard(slice));
+        }
+    }
+
+    void put(int key, int value) {
+        Shard& shard = _shardFor(key);
+        lock_guard<mutex> lock(shard.mtx);
+        shard.cache.put(key, value);
+    }
+
+    int get(int key) {
+        Shard& shard = _shardFor(key);
+        lock_guard<mutex> lock(shard.mtx);
+        return shard.cache.get(key);
+    }
+
+private:
+    struct alignas(64) Shard {
+        Shard(int capacity) : cache(capacity) {}
+        mutex mtx;
+        LRUCache cache;
+    };
+
+    Shard& _shardFor(int key) {
+        uint32_t h = static_cast<uint32_t>(key) * 0x9E3779B1u;
+        return *_shards[(h >> 16) % _numShards];
+    }
+
+    int _numShards;
+    vector<unique_ptr<Shard>> _shards;
+};
+
+// When an L1 entry may still be served.
+enum class L1Policy {
+    // Never stale: a put bumps the epoch of the key's stripe, which invalidates
+    // the entries of that stripe in every L1. A get that starts after a put has
+    // returned never sees the old value.
+    EPOCH,
+    // Bounded staleness: an entry is served for up to maxStaleMs after it was
+    // filled, even if the key was overwritten in the meantime. Puts touch no
+    // shared state besides L2.
+    BOUNDED_STALENESS,
+};
+
+// Point-in-time sum of the L1 counters of all the threads.
+struct TwoTierStats {
+    uint64_t l1Hits = 0;
+    uint64_t l2Hits = 0;
+    uint64_t misses = 0;
+
+    double l1HitRatio() const {
+        uint64_t gets = l1Hits + l2Hits + misses;
+        return gets == 0 ? 0.0 : static_cast<double>(l1Hits) / gets;
+    }
+
+    // Hits in L2 among the gets that missed L1.
+    double l2HitRatio() const {
+        uint64_t l1Misses = l2Hits + misses;
+        return l1Misses == 0 ? 0.0 : static_cast<double>(l2Hits) / l1Misses;
+    }
+};
+
+// LRU cache with the get/put interface of LRUCache, in two tiers:
+// * L1: a small 2-way set-associative cache per thread (per cache and thread),
+//   which only that thread reads and writes, so the hottest keys are served
+//   from the core's own cache lines, without taking any lock;
+// * L2: the shared ShardedLRUCache, which holds the capacity.
+// A get is served by L1 when it holds a valid entry for the key; otherwise it
+// reads L2 and fills L1 with the result. A put writes L2 and, in EPOCH mode,
+// invalidates the key in all the L1s.
+//
+// L1 hits do not reach L2, so L2 would not see the hottest keys as recently used
+// and could evict them. One L1 hit in TOUCH_EVERY is forwarded to L2 to keep
+// their recency fresh.
+class TwoTierCache {
+public:
+    TwoTierCache(int capacity, L1Policy policy = L1Policy::EPOCH, int maxStaleMs = 10, int numShards = 16)
+        : _id(_nextId.fetch_add(1)), _policy(policy), _maxStaleMs(maxStaleMs), _l2(capacity, numShards),
+          _epochs(new Epoch[EPOCH_STRIPES]) {}
+
+    int get(int key) {
+        L1& l1 = _localL1();
+        uint32_t stripe = _stripe(key);
+        uint32_t stamp = _stamp(stripe);
+
+        L1::Entry* e = l1.find(key);
+        if (e != nullptr && _valid(*e, stamp)) {
+            StatsSlot::inc(l1.stats.l1Hits);
+            if (++l1.hitsSinceTouch == TOUCH_EVERY) {
+                l1.hitsSinceTouch = 0;
+                _l2.get(key);
+            }
+            return e->value;
+        }
+
+        // Read the stamp before L2: a put that lands in between makes the new
+        // entry invalid right away instead of leaving a stale value behind, and
+        // the staleness of the entry is counted from before the read.
+        int value = _l2.get(key);
+        if (value == -1) {
+            StatsSlot::inc(l1.stats.misses);
+            return -1;
+        }
+        StatsSlot::inc(l1.stats.l2Hits);
+        l1.fill(key, value, stamp);
+        return value;
+    }
+
+    void put(int key, int value) {
+        _l2.put(key, value);
+        if (_policy == L1Policy::EPOCH) {
+            // After L2, so that a get that sees the new epoch also sees the new value.
+            _epochs[_stripe(key)].value.fetch_add(1, memory_order_release);
+        }
+    }
+
+    // Sums the counters of the L1s of all the threads.
+    TwoTierStats snapshot() {
+        TwoTierStats s;
+        lock_guard<mutex> lock(_l1sMtx);
+        for (unique_ptr<L1> const & l1 : _l1s) {
+            s.l1Hits += l1->stats.l1Hits.load(memory_order_relaxed);
+            s.l2Hits += l1->stats.l2Hits.load(memory_order_relaxed);
+            s.misses += l1->stats.misses.load(memory_order_relaxed);
+        }
+        return s;
+    }
+
+private:
+    static const int L1_SETS = 512;
+    static const int EPOCH_STRIPES = 1024;
+    static const int TOUCH_EVERY = 64;
+
+    // Counters of one L1, only written by its thread: load + store is enough,
+    // the atomics only let snapshot read them.
+    struct StatsSlot {
+        atomic<uint64_t> l1Hits{0};
+        atomic<uint64_t> l2Hits{0};
+        atomic<uint64_t> misses{0};
+
+        static void inc(atomic<uint64_t>& counter) {
+            counter.store(counter.load(memory_order_relaxed) + 1, memory_order_relaxed);
+        }
+    };
+
+    // 2-way set-associative cache of L1_SETS sets, with one LRU bit per set.
+    // The stamp of an entry is the epoch of its stripe when it was filled, or in
+    // BOUNDED_STALENESS mode the fill time in ms (see _valid).
+    struct L1 {
+        struct Entry {
+            int key;
+            int value;
+            uint32_t stamp;
+            bool used;
+        };
+
+        struct Set {
+            Entry ways[2];
+            // Way to replace next.
+            uint8_t victim;
+        };
+
+        Set sets[L1_SETS];
+        StatsSlot stats;
+        int hitsSinceTouch = 0;
+
+        L1() {
+            for (Set& s : sets) {
+                s.ways[0].used = false;
+                s.ways[1].used = false;
+                s.victim = 0;
+            }
+        }
+
+        static uint32_t setOf(int key) {
+            return (static_cast<uint32_t>(key) * 0x9E3779B1u) >> (32 - 9);
+        }
+
+        Entry* find(int key) {
+            Set& s = sets[setOf(key)];
+            for (int w = 0; w < 2; ++w) {
+                if (s.ways[w].used && s.ways[w].key == key) {
+                    s.victim = 1 - w;
+                    return &s.ways[w];
+                }
+            }
+            return nullptr;
+        }
+
+        void fill(int key, int value, uint32_t stamp) {
+            Set& s = sets[setOf(key)];
+            int w = s.victim;
+            if (s.ways[0].used && s.ways[0].key == key) {
+                w = 0;
+            } else if (s.ways[1].used && s.ways[1].key == key) {
+                w = 1;
+            }
+            s.ways[w] = Entry{key, value, stamp, true};
+            s.victim = 1 - w;
+        }
+    };
+
+    static_assert((1 << 9) == L1_SETS, "setOf assumes 512 sets");
+
+    // Each stripe on its own cache line: a put only invalidates the line of its
+    // stripe in the other cores, not those of its neighbours.
+    struct alignas(64) Epoch {
+        atomic<uint32_t> value{0};
+    };
+
+    static uint32_t _stripe(int key) {
+        return (static_cast<uint32_t>(key) * 0x85EBCA6Bu) >> 22;
+    }
+
+    // The current epoch of the stripe, or the current time in ms (wrapping
+    // around every 49 days, which the unsigned difference in _valid absorbs).
+    uint32_t _stamp(uint32_t stripe) {
+        if (_policy == L1Policy::EPOCH) {
+            return _epochs[stripe].value.load(memory_order_acquire);
+        }
+        return static_cast<uint32_t>(chrono::duration_cast<chrono::milliseconds>(
+            chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    // EPOCH: no put on the stripe since the fill. BOUNDED_STALENESS: filled less
+    // than maxStaleMs ago, read from the clock on every get (a cached tick would
+    // let a thread that gets rarely serve entries long past the bound).
+    bool _valid(L1::Entry const & e, uint32_t stamp) const {
+        if (_policy == L1Policy::EPOCH) {
+            return e.stamp == stamp;
+        }
+        return stamp - e.stamp < static_cast<uint32_t>(_maxStaleMs);
+    }
+
+    // The L1 of this thread for this cache, created on first use. The cache owns
+    // all its L1s (so that snapshot can read them); each thread remembers its own
+    // by cache id, which is never reused.
+    L1& _localL1() {
+        thread_local uint64_t lastId = 0;
+        thread_local L1* last = nullptr;
+        if (lastId == _id) {
+            return *last;
+        }
+
+        thread_local unordered_map<uint64_t, L1*> mine;
+        L1*& l1 = mine[_id];
+        if (l1 == nullptr) {
+            lock_guard<mutex> lock(_l1sMtx);
+            _l1s.emplace_back(new L1());
+            l1 = _l1s.back().get();
+        }
+        lastId = _id;
+        last = l1;
+        return *l1;
+    }
+
+    static atomic<uint64_t> _nextId;
+
+    uint64_t _id;
+    L1Policy _policy;
+    int _maxStaleMs;
+    ShardedLRUCache _l2;
+    unique_ptr<Epoch[]> _epochs;
+
+    mutex _l1sMtx;
+    vector<unique_ptr<L1>> _l1s;
+};
+
+atomic<uint64_t> TwoTierCache::_nextId(1);
+
+struct XorShift {
+    uint64_t s;
+    XorShift(uint64_t seed) : s(seed) {}
+    uint64_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+// numThreads workers on the same cache, each with its own Zipfian key stream,
+// read-through (get, put on a miss) with 1% of extra puts. Returns Mops/s.
+template <typename Cache>
+double benchmark(Cache& cache, vector<vector<int>> const & keys, int numThreads) {
+    atomic<bool> go(false);
+    atomic<long long> checksum(0);
+    vector<thread> workers;
+    for (int t = 0; t < numThreads; ++t) {
+        workers.emplace_back([&, t]() {
+            vector<int> const & myKeys = keys[t];
+            long long sum = 0;
+            while (!go.load()) {
+                this_thread::yield();
+            }
+            for (size_t i = 0; i < myKeys.size(); ++i) {
+                int key = myKeys[i];
+                if (i % 100 == 0) {
+                    cache.put(key, key);
+                    continue;
+                }
+                int value = cache.get(key);
+                if (value == -1) {
+                    cache.put(key, key);
+                } else {
+                    sum += value;
+                }
+            }
+            checksum += sum;
+        });
+    }
+
+    auto start = chrono::steady_clock::now();
+    go = true;
+    for (thread& w : workers) {
+        w.join();
+    }
+    auto end = chrono::steady_clock::now();
+    return numThreads * keys[0].size() / chrono::duration<double>(end - start).count() / 1e6;
+}
+
+int main() {
+    int capacity = 2;
+    // A single L2 shard, so that L2 is exactly the LRUCache of the example.
+    TwoTierCache* cache = new TwoTierCache(capacity, L1Policy::EPOCH, 10, 1);
+
+    cout << "cache->put(1, 1)" << endl;
+    cache->put(1, 1);
+    cout << "cache->put(2, 2)" << endl;
+    cache->put(2, 2);
+    cout << "cache->get(1): " << cache->get(1) << endl;
+    cout << "cache->get(1): " << cache->get(1) << " (L1)" << endl;
+    cout << "cache->put(1, 10)" << endl;
+    cache->put(1, 10);
+    cout << "cache->get(1): " << cache->get(1) << endl;
+    assert(cache->get(1) == 10);
+    TwoTierStats s = cache->snapshot();
+    assert(s.l1Hits == 2 && s.l2Hits == 2 && s.misses == 0);
+    delete cache;
+    cout << endl;
+
+    // EPOCH: a put on one thread is seen by the next get on every other thread,
+    // even if they had the old value in L1.
+    {
+        TwoTierCache shared(1000);
+        for (int k = 0; k < 100; ++k) {
+            shared.put(k, 0);
+        }
+        int numReaders = 4;
+        atomic<int> round(0);
+        atomic<int> done(0);
+        vector<thread> readers;
+        for (int t = 0; t < numReaders; ++t) {
+            readers.emplace_back([&]() {
+                for (int r = 1; r <= 100; ++r) {
+                    while (round.load() < r) {
+                        this_thread::yield();
+                    }
+                    for (int k = 0; k < 100; ++k) {
+                        // Warm L1 with the value of this round, then check it.
+                        assert(shared.get(k) == r);
+                        assert(shared.get(k) == r);
+                    }
+                    ++done;
+                }
+            });
+        }
+        for (int r = 1; r <= 100; ++r) {
+            for (int k = 0; k < 100; ++k) {
+                shared.put(k, r);
+            }
+            round = r;
+            while (done.load() < r * numReaders) {
+                this_thread::yield();
+            }
+        }
+        for (thread& t : readers) {
+            t.join();
+        }
+        assert(shared.snapshot().l1Hits > 0);
+        cout << "EPOCH: no stale reads across " << numReaders << " threads." << endl;
+    }
+
+    // BOUNDED_STALENESS: the old value may be served, but not after maxStaleMs.
+    {
+        TwoTierCache bounded(100, L1Policy::BOUNDED_STALENESS, 5);
+        bounded.put(1, 1);
+        assert(bounded.get(1) == 1);
+        bounded.put(1, 2);
+        // A slow reader: a single get, once the bound has passed.
+        this_thread::sleep_for(chrono::milliseconds(10));
+        assert(bounded.get(1) == 2);
+
+        // Within the bound, the old value may still be served, but nothing
+        // older than maxStaleMs.
+        TwoTierCache lenient(100, L1Policy::BOUNDED_STALENESS, 1000);
+        lenient.put(1, 1);
+        assert(lenient.get(1) == 1);
+        lenient.put(1, 2);
+        assert(lenient.get(1) == 1);
+        this_thread::sleep_for(chrono::milliseconds(1100));
+        assert(lenient.get(1) == 2);
+        cout << "BOUNDED_STALENESS: new value served once maxStaleMs has passed." << endl << endl;
+    }
+
+    int numKeys = 1000000;
+    int cacheCapacity = 100000;
+    int opsPerThread = 500000;
+    int maxThreads = 16;
+
+    vector<double> cdf(numKeys);
+    double sum = 0.0;
+    for (int k = 0; k < numKeys; ++k) {
+        sum += 1.0 / pow(k + 1, 0.99);
+        cdf[k] = sum;
+    }
+    vector<vector<int>> keys(maxThreads, vector<int>(opsPerThread));
+    for (int t = 0; t < maxThreads; ++t) {
+        XorShift rng(t + 1);
+        for (int& key : keys[t]) {
+            double u = (rng.next() >> 11) * (1.0 / 9007199254740992.0) * sum;
+            key = lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+        }
+    }
+
+    cout << "Benchmark (Zipf 0.99 over " << numKeys << " keys, capacity " << cacheCapacity
+         << ", read-through + 1% puts), hardware threads: " << thread::hardware_concurrency() << endl;
+    cout << "threads  L2 only (Mops/s)  L1+L2 epoch (Mops/s)  L1+L2 10ms stale (Mops/s)  L1 hits  L2 hits (of L1 misses)" << endl;
+    for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+        ShardedLRUCache l2Only(cacheCapacity);
+        TwoTierCache epoch(cacheCapacity, L1Policy::EPOCH);
+        TwoTierCache stale(cacheCapacity, L1Policy::BOUNDED_STALENESS, 10);
+        double l2Mops = benchmark(l2Only, keys, numThreads);
+        double epochMops = benchmark(epoch, keys, numThreads);
+        double staleMops = benchmark(stale, keys, numThreads);
+        TwoTierStats es = epoch.snapshot();
+        cout << numThreads << "\t " << l2Mops << "\t\t    " << epochMops << "\t\t  " << staleMops
+             << "\t\t\t     " << 100 * es.l1HitRatio() << "%   " << 100 * es.l2HitRatio() << "%" << endl;
+    }
+    return 0;
+}
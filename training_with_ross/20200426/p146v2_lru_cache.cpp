@@ -0,0 +1,166 @@
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Same interface as the LRUCache in p146_lru_cache.cpp, but every operation is O(1):
+// the index maps each key straight to its node in the recency list, so promoting,
+// inserting and evicting never have to walk the list.
+class LRUCache {
+public:
+    LRUCache(int capacity) : _capacity(capacity) {
+        _m.reserve(capacity);
+    }
+
+    void put(int key, int value) {
+        if (_capacity <= 0) {
+            return;
+        }
+
+        unordered_map<int, list<pair<int, int>>::iterator>::iterator it = _m.find(key);
+        if (it != _m.end()) {
+            // Existing key: update the value and move it to the back of the queue.
+            it->second->second = value;
+            _reEnqueue(it->second);
+            return;
+        }
+
+        if (_m.size() == _capacity) {
+            // Reuse the node of the least recently used key instead of freeing it
+            // and allocating a new one.
+            list<pair<int, int>>::iterator lru = _q.begin();
+            _m.erase(lru->first);
+            lru->first = key;
+            lru->second = value;
+            _reEnqueue(lru);
+            _m[key] = lru;
+        } else {
+            _q.emplace_back(key, value);
+            _m[key] = prev(_q.end());
+        }
+        assert(_m.size() <= _capacity);
+        assert(_q.size() <= _capacity);
+    }
+
+    int get(int key) {
+        unordered_map<int, list<pair<int, int>>::iterator>::iterator it = _m.find(key);
+        if (it == _m.end()) {
+            // Key not in the cache.
+            return -1;
+        }
+
+        _reEnqueue(it->second);
+        return it->second->second;
+    }
+
+    void printQueue() {
+        cout << "Queue:" << endl;
+        string out = " <[ ";
+        for (auto& p : _q) {
+            out.append("(" + to_string(p.first) + ", " + to_string(p.second) + ") ");
+        }
+        out += "]<";
+        cout << out << endl;
+    }
+
+private:
+    void _reEnqueue(list<pair<int, int>>::iterator it) {
+        // Ensure the node is at the back of the queue. Splicing only relinks the
+        // node, so the iterator stored in the map stays valid.
+        _q.splice(_q.end(), _q, it);
+    }
+
+    int _capacity;
+
+    // Front is the least recently used entry, back the most recently used one.
+    list<pair<int, int>> _q;
+
+    // Maps a key to its node in the queue.
+    unordered_map<int, list<pair<int, int>>::iterator> _m;
+};
+
+// Cheap deterministic generator so the benchmark does not measure the RNG.
+struct XorShift {
+    uint64_t s;
+    XorShift(uint64_t seed) : s(seed) {}
+    uint64_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+// Fills the cache, then runs a mix of hits (80%) and misses (20%) and prints
+// the average ns per operation.
+void benchmark(int capacity, int numOps) {
+    LRUCache cache(capacity);
+    for (int k = 0; k < capacity; ++k) {
+        cache.put(k, k);
+    }
+
+    // Pre-generate the keys so that only the cache operations are timed.
+    XorShift rng(capacity);
+    vector<int> keys(numOps);
+    for (int i = 0; i < numOps; ++i) {
+        uint64_t r = rng.next();
+        if (r % 5 == 0) {
+            keys[i] = -1 - static_cast<int>(r % capacity);
+        } else {
+            keys[i] = static_cast<int>(r % capacity);
+        }
+    }
+
+    long long checksum = 0;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < numOps; ++i) {
+        if (i & 1) {
+            checksum += cache.get(keys[i]);
+        } else {
+            cache.put(keys[i], i);
+        }
+    }
+    auto end = chrono::steady_clock::now();
+
+    // Print the checksum so the compiler cannot drop the loop.
+    double nsPerOp = chrono::duration<double, nano>(end - start).count() / numOps;
+    cout << "capacity " << capacity << ": " << nsPerOp << " ns/op"
+         << " (checksum " << checksum << ")" << endl;
+}
+
+int main() {
+    int capacity = 2;
+    LRUCache* cache = new LRUCache(capacity);
+
+    cout << "cache->put(1, 1)" << endl;
+    cache->put(1, 1);
+    cout << "cache->put(2, 2)" << endl;
+    cache->put(2, 2);
+    cout << "cache->get(1): " << cache->get(1) << endl;
+    cout << "cache->put(3, 3)" << endl;
+    cache->put(3, 3);
+    cout << "cache->get(2): " << cache->get(2) << endl;
+    cout << "cache->put(4, 4)" << endl;
+    cache->put(4, 4);
+    cache->printQueue();
+    cout << "cache->get(1): " << cache->get(1) << endl;
+    cout << "cache->get(3): " << cache->get(3) << endl;
+    cout << "cache->get(4): " << cache->get(4) << endl;
+    delete cache;
+    cout << endl;
+
+    // ns/op should stay flat as the capacity grows: there is no scan left.
+    // (Larger caches do pay for more cache misses in the hash table.)
+    cout << "Benchmark (80% hits, 50% get / 50% put):" << endl;
+    for (int capacity : {1000, 10000, 100000, 1000000, 10000000}) {
+        benchmark(capacity, 5000000);
+    }
+    return 0;
+}
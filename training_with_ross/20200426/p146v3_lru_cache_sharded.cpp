@@ -0,0 +1,249 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// O(1) LRU cache from p146v2_lru_cache.cpp. Not thread-safe on its own.
+class LRUCache {
+public:
+    LRUCache(int capacity) : _capacity(capacity) {
+        _m.reserve(capacity);
+    }
+
+    void put(int key, int value) {
+        if (_capacity <= 0) {
+            return;
+        }
+
+        unordered_map<int, list<pair<int, int>>::iterator>::iterator it = _m.find(key);
+        if (it != _m.end()) {
+            it->second->second = value;
+            _reEnqueue(it->second);
+            return;
+        }
+
+        if (_m.size() == _capacity) {
+            list<pair<int, int>>::iterator lru = _q.begin();
+            _m.erase(lru->first);
+            lru->first = key;
+            lru->second = value;
+            _reEnqueue(lru);
+            _m[key] = lru;
+        } else {
+            _q.emplace_back(key, value);
+            _m[key] = prev(_q.end());
+        }
+    }
+
+    int get(int key) {
+        unordered_map<int, list<pair<int, int>>::iterator>::iterator it = _m.find(key);
+        if (it == _m.end()) {
+            return -1;
+        }
+
+        _reEnqueue(it->second);
+        return it->second->second;
+    }
+
+private:
+    void _reEnqueue(list<pair<int, int>>::iterator it) {
+        _q.splice(_q.end(), _q, it);
+    }
+
+    int _capacity;
+    list<pair<int, int>> _q;
+    unordered_map<int, list<pair<int, int>>::iterator> _m;
+};
+
+// Thread-safe LRU cache with the same get/put interface. The key space is split
+// into independently locked shards: each shard is a full LRUCache with its own
+// recency list and its own slice of the capacity, so threads touching different
+// shards never wait on each other.
+//
+// Recency is only exact within a shard: the evicted entry is the least recently
+// used one of its shard, not necessarily of the whole cache.
+class ShardedLRUCache {
+public:
+    ShardedLRUCache(int capacity, int numShards = 16) : _numShards(numShards) {
+        _shards.reserve(numShards);
+        for (int i = 0; i < numShards; ++i) {
+            // Spread the remainder so that the slices add up to the capacity.
+            int slice = capacity / numShards + (i < capacity % numShards ? 1 : 0);
+            _shards.emplace_back(new Shard(slice));
+        }
+    }
+
+    void put(int key, int value) {
+        Shard& shard = _shardFor(key);
+        lock_guard<mutex> lock(shard.mtx);
+        shard.cache.put(key, value);
+    }
+
+    int get(int key) {
+        Shard& shard = _shardFor(key);
+        lock_guard<mutex> lock(shard.mtx);
+        return shard.cache.get(key);
+    }
+
+private:
+    // Each shard sits on its own cache lines so that locking one shard does not
+    // invalidate the mutex of its neighbour.
+    struct alignas(64) Shard {
+        Shard(int capacity) : cache(capacity) {}
+        mutex mtx;
+        LRUCache cache;
+    };
+
+    Shard& _shardFor(int key) {
+        // Mix the bits first: sequential keys would otherwise all land in
+        // neighbouring shards and hot ranges would share a lock.
+        uint32_t h = static_cast<uint32_t>(key) * 0x9E3779B1u;
+        return *_shards[(h >> 16) % _numShards];
+    }
+
+    int _numShards;
+    vector<unique_ptr<Shard>> _shards;
+};
+
+// The baseline we are replacing: one cache behind one global mutex.
+class GlobalLockLRUCache {
+public:
+    GlobalLockLRUCache(int capacity) : _cache(capacity) {}
+
+    void put(int key, int value) {
+        lock_guard<mutex> lock(_mtx);
+        _cache.put(key, value);
+    }
+
+    int get(int key) {
+        lock_guard<mutex> lock(_mtx);
+        return _cache.get(key);
+    }
+
+private:
+    mutex _mtx;
+    LRUCache _cache;
+};
+
+struct XorShift {
+    uint64_t s;
+    XorShift(uint64_t seed) : s(seed) {}
+    uint64_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+// Samples keys in [0, n) with P(k) proportional to 1 / (k + 1)^theta.
+class ZipfGenerator {
+public:
+    ZipfGenerator(int n, double theta) : _cdf(n) {
+        double sum = 0.0;
+        for (int k = 0; k < n; ++k) {
+            sum += 1.0 / pow(k + 1, theta);
+            _cdf[k] = sum;
+        }
+        for (double& c : _cdf) {
+            c /= sum;
+        }
+    }
+
+    int next(XorShift& rng) {
+        double u = (rng.next() >> 11) * (1.0 / 9007199254740992.0);
+        return lower_bound(_cdf.begin(), _cdf.end(), u) - _cdf.begin();
+    }
+
+private:
+    vector<double> _cdf;
+};
+
+// Runs numThreads workers on the same cache, each doing keys[t].size() operations
+// (90% get, 10% put) on its own pre-generated Zipfian key stream.
+// Returns the total throughput in Mops/s.
+template <typename Cache>
+double benchmark(Cache& cache, vector<vector<int>> const & keys, int numThreads) {
+    atomic<bool> go(false);
+    atomic<long long> checksum(0);
+    vector<thread> workers;
+    for (int t = 0; t < numThreads; ++t) {
+        workers.emplace_back([&, t]() {
+            vector<int> const & myKeys = keys[t];
+            long long sum = 0;
+            while (!go.load()) {
+                this_thread::yield();
+            }
+            for (size_t i = 0; i < myKeys.size(); ++i) {
+                if (i % 10 == 0) {
+                    cache.put(myKeys[i], static_cast<int>(i));
+                } else {
+                    sum += cache.get(myKeys[i]);
+                }
+            }
+            checksum += sum;
+        });
+    }
+
+    auto start = chrono::steady_clock::now();
+    go = true;
+    for (thread& w : workers) {
+        w.join();
+    }
+    auto end = chrono::steady_clock::now();
+
+    double seconds = chrono::duration<double>(end - start).count();
+    return numThreads * keys[0].size() / seconds / 1e6;
+}
+
+int main() {
+    int capacity = 4;
+    ShardedLRUCache* cache = new ShardedLRUCache(capacity, 2);
+
+    cout << "cache->put(1, 1)" << endl;
+    cache->put(1, 1);
+    cout << "cache->put(2, 2)" << endl;
+    cache->put(2, 2);
+    cout << "cache->get(1): " << cache->get(1) << endl;
+    cout << "cache->get(2): " << cache->get(2) << endl;
+    cout << "cache->get(3): " << cache->get(3) << endl;
+    delete cache;
+    cout << endl;
+
+    int numKeys = 1000000;
+    int cacheCapacity = 100000;
+    int opsPerThread = 200000;
+    int maxThreads = 64;
+
+    ZipfGenerator zipf(numKeys, 0.99);
+    vector<vector<int>> keys(maxThreads, vector<int>(opsPerThread));
+    for (int t = 0; t < maxThreads; ++t) {
+        XorShift rng(t + 1);
+        for (int& k : keys[t]) {
+            k = zipf.next(rng);
+        }
+    }
+
+    cout << "Benchmark (Zipf 0.99 over " << numKeys << " keys, capacity " << cacheCapacity
+         << ", 90% get / 10% put), hardware threads: " << thread::hardware_concurrency() << endl;
+    cout << "threads  global lock (Mops/s)  sharded x64 (Mops/s)" << endl;
+    for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+        GlobalLockLRUCache global(cacheCapacity);
+        ShardedLRUCache sharded(cacheCapacity, 64);
+        double globalMops = benchmark(global, keys, numThreads);
+        double shardedMops = benchmark(sharded, keys, numThreads);
+        cout << numThreads << "\t " << globalMops << "\t\t\t" << shardedMops << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,389 @@
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Allocations made by the containers of both caches, so that main() can check
+// that the steady state of the slab cache never allocates.
+static long long numAllocations = 0;
+
+// std::allocator that counts its allocations in numAllocations.
+template <typename T>
+struct CountingAllocator {
+    typedef T value_type;
+
+    CountingAllocator() {}
+
+    template <typename U>
+    CountingAllocator(CountingAllocator<U> const &) {}
+
+    T* allocate(size_t n) {
+        ++numAllocations;
+        return allocator<T>().allocate(n);
+    }
+
+    void deallocate(T* p, size_t n) {
+        allocator<T>().deallocate(p, n);
+    }
+};
+
+template <typename T, typename U>
+bool operator==(CountingAllocator<T> const &, CountingAllocator<U> const &) {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(CountingAllocator<T> const &, CountingAllocator<U> const &) {
+    return false;
+}
+
+// Generic LRU cache that allocates everything in its constructor:
+// * all the entries live in one contiguous slab, and the recency list is threaded
+//   through them with 32-bit indices instead of pointers;
+// * the key index is an open-addressing (linear probing) table of 32-bit slab
+//   indices, so a lookup touches a couple of cache lines instead of chasing the
+//   nodes of a tree or of a bucket list.
+// Once the cache is built, get and put never call the allocator (as long as
+// copying K and V does not).
+template <typename K, typename V, typename Hash = hash<K>>
+class LRUCache {
+public:
+    LRUCache(int capacity) : _capacity(capacity), _size(0), _head(NIL), _tail(NIL) {
+        assert(capacity >= 0);
+        _nodes.resize(capacity);
+
+        // Keep the load factor at or below 50% so that probe sequences stay short.
+        size_t numSlots = 1;
+        while (numSlots < 2 * static_cast<size_t>(capacity)) {
+            numSlots <<= 1;
+        }
+        _slots.assign(numSlots, NIL);
+        _mask = numSlots - 1;
+    }
+
+    // Returns true and sets value if the key is in the cache.
+    bool get(K const & key, V& value) {
+        uint32_t slot = _findSlot(key);
+        uint32_t idx = _slots[slot];
+        if (idx == NIL) {
+            // Key not in the cache.
+            return false;
+        }
+
+        _reEnqueue(idx);
+        value = _nodes[idx].value;
+        return true;
+    }
+
+    void put(K const & key, V const & value) {
+        if (_capacity == 0) {
+            return;
+        }
+
+        uint32_t slot = _findSlot(key);
+        uint32_t idx = _slots[slot];
+        if (idx != NIL) {
+            // Existing key: update the value and move it to the back of the queue.
+            _nodes[idx].value = value;
+            _reEnqueue(idx);
+            return;
+        }
+
+        if (_size == _capacity) {
+            // Recycle the least recently used entry.
+            idx = _head;
+            _unlink(idx);
+            _eraseSlot(_findSlot(_nodes[idx].key));
+
+            // Erasing may have shifted the entries after it: look the slot up again.
+            slot = _findSlot(key);
+        } else {
+            idx = _size++;
+        }
+
+        _nodes[idx].key = key;
+        _nodes[idx].value = value;
+        _pushBack(idx);
+        _slots[slot] = idx;
+    }
+
+    int size() const {
+        return _size;
+    }
+
+    void printQueue() {
+        cout << "Queue:" << endl;
+        string out = " <[ ";
+        for (uint32_t idx = _head; idx != NIL; idx = _nodes[idx].next) {
+            out.append("(" + to_string(_nodes[idx].key) + ", " + to_string(_nodes[idx].value) + ") ");
+        }
+        out += "]<";
+        cout << out << endl;
+    }
+
+private:
+    static constexpr uint32_t NIL = 0xFFFFFFFFu;
+
+    struct Node {
+        K key;
+        V value;
+        uint32_t prev;
+        uint32_t next;
+    };
+
+    size_t _home(K const & key) const {
+        // Fibonacci hashing: spreads poor hashes (e.g. the identity for integers)
+        // over the whole table.
+        uint64_t h = static_cast<uint64_t>(_hash(key)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(h >> 32) & _mask;
+    }
+
+    // Returns the slot holding the key, or the empty slot where it would go.
+    uint32_t _findSlot(K const & key) const {
+        size_t slot = _home(key);
+        while (_slots[slot] != NIL && !(_nodes[_slots[slot]].key == key)) {
+            slot = (slot + 1) & _mask;
+        }
+        return static_cast<uint32_t>(slot);
+    }
+
+    // Backward-shift deletion: pull later entries of the probe sequence into the
+    // hole, so that lookups never need tombstones.
+    void _eraseSlot(size_t hole) {
+        size_t slot = hole;
+        while (true) {
+            slot = (slot + 1) & _mask;
+            uint32_t idx = _slots[slot];
+            if (idx == NIL) {
+                break;
+            }
+            // The entry may move into the hole only if its home is not in (hole, slot].
+            size_t home = _home(_nodes[idx].key);
+            if (((slot - home) & _mask) >= ((slot - hole) & _mask)) {
+                _slots[hole] = idx;
+                hole = slot;
+            }
+        }
+        _slots[hole] = NIL;
+    }
+
+    void _unlink(uint32_t idx) {
+        Node& n = _nodes[idx];
+        if (n.prev != NIL) {
+            _nodes[n.prev].next = n.next;
+        } else {
+            _head = n.next;
+        }
+        if (n.next != NIL) {
+            _nodes[n.next].prev = n.prev;
+        } else {
+            _tail = n.prev;
+        }
+    }
+
+    void _pushBack(uint32_t idx) {
+        Node& n = _nodes[idx];
+        n.prev = _tail;
+        n.next = NIL;
+        if (_tail != NIL) {
+            _nodes[_tail].next = idx;
+        } else {
+            _head = idx;
+        }
+        _tail = idx;
+    }
+
+    void _reEnqueue(uint32_t idx) {
+        // Ensure the entry is at the back of the queue.
+        if (idx != _tail) {
+            _unlink(idx);
+            _pushBack(idx);
+        }
+    }
+
+    int _capacity;
+    int _size;
+
+    // Front (least recently used) and back (most recently used) of the queue.
+    uint32_t _head;
+    uint32_t _tail;
+
+    vector<Node, CountingAllocator<Node>> _nodes;
+    vector<uint32_t, CountingAllocator<uint32_t>> _slots;
+    size_t _mask;
+    Hash _hash;
+};
+
+// The std::list/std::map LRUCache of p146_lru_cache.cpp, kept as the baseline.
+class ListMapLRUCache {
+private:
+    void _reEnqueue(int key) {
+        list<int, CountingAllocator<int>>::iterator it = q.begin();
+        for (; it != q.end() && *it != key; ++it) {}
+        if (it != q.end()) {
+            q.erase(it);
+        }
+        q.push_back(key);
+    }
+
+public:
+    ListMapLRUCache(int capacity) : _capacity(capacity) {};
+
+    void put(int key, int value) {
+        if (m.find(key) != m.end()) {
+            _reEnqueue(key);
+        } else {
+            q.push_back(key);
+        }
+        m[key] = value;
+
+        if (q.size() > static_cast<size_t>(_capacity)) {
+            m.erase(q.front());
+            q.pop_front();
+        }
+    }
+
+    int get(int key) {
+        map<int, int, less<int>, CountingAllocator<pair<int const, int>>>::iterator it = m.find(key);
+        if (it == m.end()) {
+            return -1;
+        }
+
+        _reEnqueue(key);
+        return it->second;
+    }
+
+private:
+    int _capacity;
+    map<int, int, less<int>, CountingAllocator<pair<int const, int>>> m;
+    list<int, CountingAllocator<int>> q;
+};
+
+struct XorShift {
+    uint64_t s;
+    XorShift(uint64_t seed) : s(seed) {}
+    uint64_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+// Keys drawn from twice the capacity, so that about half of the operations miss
+// and half of the puts evict.
+vector<int> makeKeys(int capacity, int numOps) {
+    XorShift rng(capacity);
+    vector<int> keys(numOps);
+    for (int& k : keys) {
+        k = static_cast<int>(rng.next() % (2 * capacity));
+    }
+    return keys;
+}
+
+// Same operation mix on both caches. Prints ns/op and the number of allocations
+// done after the cache was built.
+void compare(int capacity, int numOps) {
+    vector<int> keys = makeKeys(capacity, numOps);
+    long long checksum = 0;
+
+    ListMapLRUCache listMap(capacity);
+    long long allocsBefore = numAllocations;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < numOps; ++i) {
+        if (i & 1) {
+            checksum += listMap.get(keys[i]);
+        } else {
+            listMap.put(keys[i], i);
+        }
+    }
+    auto end = chrono::steady_clock::now();
+    double listMapNs = chrono::duration<double, nano>(end - start).count() / numOps;
+    long long listMapAllocs = numAllocations - allocsBefore;
+
+    LRUCache<int, int> slab(capacity);
+    allocsBefore = numAllocations;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < numOps; ++i) {
+        if (i & 1) {
+            int value = -1;
+            slab.get(keys[i], value);
+            checksum -= value;
+        } else {
+            slab.put(keys[i], i);
+        }
+    }
+    end = chrono::steady_clock::now();
+    double slabNs = chrono::duration<double, nano>(end - start).count() / numOps;
+    long long slabAllocs = numAllocations - allocsBefore;
+
+    // Both caches see the same operations, so the checksum must cancel out.
+    assert(checksum == 0);
+    assert(listMapAllocs > 0);
+    assert(slabAllocs == 0);
+
+    cout << "capacity " << capacity << ", " << numOps << " ops:" << endl;
+    cout << "  list/map: " << listMapNs << " ns/op, " << listMapAllocs << " allocations" << endl;
+    cout << "  slab:     " << slabNs << " ns/op, " << slabAllocs << " allocations" << endl;
+}
+
+int main() {
+    int capacity = 2;
+    LRUCache<int, int>* cache = new LRUCache<int, int>(capacity);
+    int value;
+
+    cout << "cache->put(1, 1)" << endl;
+    cache->put(1, 1);
+    cout << "cache->put(2, 2)" << endl;
+    cache->put(2, 2);
+    cout << "cache->get(1): " << (cache->get(1, value) ? value : -1) << endl;
+    cout << "cache->put(3, 3)" << endl;
+    cache->put(3, 3);
+    cout << "cache->get(2): " << (cache->get(2, value) ? value : -1) << endl;
+    cout << "cache->put(4, 4)" << endl;
+    cache->put(4, 4);
+    cache->printQueue();
+    cout << "cache->get(1): " << (cache->get(1, value) ? value : -1) << endl;
+    cout << "cache->get(3): " << (cache->get(3, value) ? value : -1) << endl;
+    cout << "cache->get(4): " << (cache->get(4, value) ? value : -1) << endl;
+    delete cache;
+    cout << endl;
+
+    // The list/map version scans its queue on every hit, so keep it to small
+    // capacities.
+    compare(100, 2000000);
+    compare(1000, 1000000);
+    compare(10000, 100000);
+
+    // Larger slab cache on its own, with a non-trivial key type.
+    int bigCapacity = 1000000;
+    LRUCache<long long, int> big(bigCapacity);
+    XorShift rng(42);
+    long long allocsBefore = numAllocations;
+    auto start = chrono::steady_clock::now();
+    int numOps = 10000000;
+    long long hits = 0;
+    for (int i = 0; i < numOps; ++i) {
+        long long key = static_cast<long long>(rng.next() % (2 * bigCapacity)) << 20;
+        if (big.get(key, value)) {
+            ++hits;
+        } else {
+            big.put(key, i);
+        }
+    }
+    auto end = chrono::steady_clock::now();
+    assert(numAllocations == allocsBefore);
+    cout << "slab capacity " << bigCapacity << ": "
+         << chrono::duration<double, nano>(end - start).count() / numOps << " ns/op, "
+         << hits << " hits, " << numAllocations - allocsBefore << " allocations" << endl;
+    return 0;
+}
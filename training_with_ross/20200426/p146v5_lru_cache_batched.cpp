@@ -0,0 +1,360 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <span>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Generic LRU cache that allocates everything in its constructor:
+// * all the entries live in one contiguous slab, and the recency list is threaded
+//   through them with 32-bit indices instead of pointers;
+// * the key index is an open-addressing (linear probing) table of 32-bit slab
+//   indices, so a lookup touches a couple of cache lines instead of chasing the
+//   nodes of a tree or of a bucket list.
+// Once the cache is built, get and put never call the allocator (as long as
+// copying K and V does not).
+//
+// Slab LRU cache of p146v4_lru_cache_slab.cpp, plus batched multiGet/multiPut.
+// A batch is resolved in three passes so that the cache misses of different keys
+// overlap instead of being paid one after the other:
+// 1. hash every key and prefetch its home slot;
+// 2. read the home slots and prefetch the entries they point to;
+// 3. run the plain get/put of each key, in order.
+// The prefetches are only hints: the third pass is exactly the sequence of
+// single-key calls, so the results and the final recency order are the same as
+// calling get/put in a loop.
+template <typename K, typename V, typename Hash = hash<K>>
+class LRUCache {
+public:
+    LRUCache(int capacity) : _capacity(capacity), _size(0), _head(NIL), _tail(NIL) {
+        assert(capacity >= 0);
+        _nodes.resize(capacity);
+
+        // Keep the load factor at or below 50% so that probe sequences stay short.
+        size_t numSlots = 1;
+        while (numSlots < 2 * static_cast<size_t>(capacity)) {
+            numSlots <<= 1;
+        }
+        _slots.assign(numSlots, NIL);
+        _mask = numSlots - 1;
+    }
+
+    // Returns true and sets value if the key is in the cache.
+    bool get(K const & key, V& value) {
+        uint32_t slot = _findSlot(key);
+        uint32_t idx = _slots[slot];
+        if (idx == NIL) {
+            // Key not in the cache.
+            return false;
+        }
+
+        _reEnqueue(idx);
+        value = _nodes[idx].value;
+        return true;
+    }
+
+    void put(K const & key, V const & value) {
+        if (_capacity == 0) {
+            return;
+        }
+
+        uint32_t slot = _findSlot(key);
+        uint32_t idx = _slots[slot];
+        if (idx != NIL) {
+            // Existing key: update the value and move it to the back of the queue.
+            _nodes[idx].value = value;
+            _reEnqueue(idx);
+            return;
+        }
+
+        if (_size == _capacity) {
+            // Recycle the least recently used entry.
+            idx = _head;
+            _unlink(idx);
+            _eraseSlot(_findSlot(_nodes[idx].key));
+
+            // Erasing may have shifted the entries after it: look the slot up again.
+            slot = _findSlot(key);
+        } else {
+            idx = _size++;
+        }
+
+        _nodes[idx].key = key;
+        _nodes[idx].value = value;
+        _pushBack(idx);
+        _slots[slot] = idx;
+    }
+
+    // values[i] is set to the value of keys[i], or to missing if it is not cached.
+    void multiGet(span<K const> keys, span<V> values, V const & missing) {
+        assert(keys.size() == values.size());
+        for (size_t lo = 0; lo < keys.size(); lo += BATCH) {
+            size_t n = min(BATCH, keys.size() - lo);
+            _prefetchBatch(keys.subspan(lo, n));
+            for (size_t i = lo; i < lo + n; ++i) {
+                if (!get(keys[i], values[i])) {
+                    values[i] = missing;
+                }
+            }
+        }
+    }
+
+    // Same as calling put(keys[i], values[i]) for every i, in order.
+    void multiPut(span<K const> keys, span<V const> values) {
+        assert(keys.size() == values.size());
+        for (size_t lo = 0; lo < keys.size(); lo += BATCH) {
+            size_t n = min(BATCH, keys.size() - lo);
+            _prefetchBatch(keys.subspan(lo, n));
+            for (size_t i = lo; i < lo + n; ++i) {
+                put(keys[i], values[i]);
+            }
+        }
+    }
+
+    int size() const {
+        return _size;
+    }
+
+    void printQueue() {
+        cout << "Queue:" << endl;
+        string out = " <[ ";
+        for (uint32_t idx = _head; idx != NIL; idx = _nodes[idx].next) {
+            out.append("(" + to_string(_nodes[idx].key) + ", " + to_string(_nodes[idx].value) + ") ");
+        }
+        out += "]<";
+        cout << out << endl;
+    }
+
+private:
+    static constexpr uint32_t NIL = 0xFFFFFFFFu;
+
+    // Keys prefetched at once: enough to hide the memory latency, few enough that
+    // the prefetched lines are still in L1 when the third pass reaches them.
+    static constexpr size_t BATCH = 32;
+
+    struct Node {
+        K key;
+        V value;
+        uint32_t prev;
+        uint32_t next;
+    };
+
+    size_t _home(K const & key) const {
+        // Fibonacci hashing: spreads poor hashes (e.g. the identity for integers)
+        // over the whole table.
+        uint64_t h = static_cast<uint64_t>(_hash(key)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(h >> 32) & _mask;
+    }
+
+    // Returns the slot holding the key, or the empty slot where it would go.
+    uint32_t _findSlot(K const & key) const {
+        size_t slot = _home(key);
+        while (_slots[slot] != NIL && !(_nodes[_slots[slot]].key == key)) {
+            slot = (slot + 1) & _mask;
+        }
+        return static_cast<uint32_t>(slot);
+    }
+
+    // First two passes of a batch (see the class comment).
+    void _prefetchBatch(span<K const> keys) {
+        size_t homes[BATCH];
+        for (size_t i = 0; i < keys.size(); ++i) {
+            homes[i] = _home(keys[i]);
+            __builtin_prefetch(&_slots[homes[i]]);
+        }
+        uint32_t idxs[BATCH];
+        for (size_t i = 0; i < keys.size(); ++i) {
+            idxs[i] = _slots[homes[i]];
+            if (idxs[i] != NIL) {
+                // Write prefetch: a hit moves the entry in the queue.
+                __builtin_prefetch(&_nodes[idxs[i]], 1);
+            }
+        }
+        for (size_t i = 0; i < keys.size(); ++i) {
+            if (idxs[i] != NIL) {
+                Node const & n = _nodes[idxs[i]];
+                if (n.prev != NIL) {
+                    __builtin_prefetch(&_nodes[n.prev], 1);
+                }
+                if (n.next != NIL) {
+                    __builtin_prefetch(&_nodes[n.next], 1);
+                }
+            }
+        }
+    }
+
+    // Backward-shift deletion: pull later entries of the probe sequence into the
+    // hole, so that lookups never need tombstones.
+    void _eraseSlot(size_t hole) {
+        size_t slot = hole;
+        while (true) {
+            slot = (slot + 1) & _mask;
+            uint32_t idx = _slots[slot];
+            if (idx == NIL) {
+                break;
+            }
+            // The entry may move into the hole only if its home is not in (hole, slot].
+            size_t home = _home(_nodes[idx].key);
+            if (((slot - home) & _mask) >= ((slot - hole) & _mask)) {
+                _slots[hole] = idx;
+                hole = slot;
+            }
+        }
+        _slots[hole] = NIL;
+    }
+
+    void _unlink(uint32_t idx) {
+        Node& n = _nodes[idx];
+        if (n.prev != NIL) {
+            _nodes[n.prev].next = n.next;
+        } else {
+            _head = n.next;
+        }
+        if (n.next != NIL) {
+            _nodes[n.next].prev = n.prev;
+        } else {
+            _tail = n.prev;
+        }
+    }
+
+    void _pushBack(uint32_t idx) {
+        Node& n = _nodes[idx];
+        n.prev = _tail;
+        n.next = NIL;
+        if (_tail != NIL) {
+            _nodes[_tail].next = idx;
+        } else {
+            _head = idx;
+        }
+        _tail = idx;
+    }
+
+    void _reEnqueue(uint32_t idx) {
+        // Ensure the entry is at the back of the queue.
+        if (idx != _tail) {
+            _unlink(idx);
+            _pushBack(idx);
+        }
+    }
+
+    int _capacity;
+    int _size;
+
+    // Front (least recently used) and back (most recently used) of the queue.
+    uint32_t _head;
+    uint32_t _tail;
+
+    vector<Node> _nodes;
+    vector<uint32_t> _slots;
+    size_t _mask;
+    Hash _hash;
+};
+
+struct XorShift {
+    uint64_t s;
+    XorShift(uint64_t seed) : s(seed) {}
+    uint64_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+// Runs the same batches of gets (and one put per missed key) on two identical
+// caches, one through a loop of get/put and one through multiGet/multiPut.
+// Asserts that both return the same values and prints ns per key.
+void compare(int capacity, int batchSize, int numKeys) {
+    LRUCache<int, int> looped(capacity);
+    LRUCache<int, int> batched(capacity);
+
+    // Keys drawn from 1.25x the capacity: about 80% hits.
+    XorShift rng(batchSize);
+    vector<int> keys(numKeys);
+    for (int& k : keys) {
+        k = static_cast<int>(rng.next() % (capacity + capacity / 4));
+    }
+
+    // Warm both caches up with the same content.
+    for (int k = 0; k < capacity; ++k) {
+        looped.put(k, k);
+        batched.put(k, k);
+    }
+
+    vector<int> loopedValues(numKeys);
+    vector<int> missedKeys;
+    missedKeys.reserve(batchSize);
+    auto start = chrono::steady_clock::now();
+    for (int lo = 0; lo + batchSize <= numKeys; lo += batchSize) {
+        missedKeys.clear();
+        for (int i = lo; i < lo + batchSize; ++i) {
+            if (!looped.get(keys[i], loopedValues[i])) {
+                loopedValues[i] = -1;
+                missedKeys.push_back(keys[i]);
+            }
+        }
+        for (int k : missedKeys) {
+            looped.put(k, k);
+        }
+    }
+    auto end = chrono::steady_clock::now();
+    double loopedNs = chrono::duration<double, nano>(end - start).count() / numKeys;
+
+    vector<int> batchedValues(numKeys);
+    start = chrono::steady_clock::now();
+    for (int lo = 0; lo + batchSize <= numKeys; lo += batchSize) {
+        span<int const> batch(&keys[lo], batchSize);
+        batched.multiGet(batch, span<int>(&batchedValues[lo], batchSize), -1);
+        missedKeys.clear();
+        for (int i = lo; i < lo + batchSize; ++i) {
+            if (batchedValues[i] == -1) {
+                missedKeys.push_back(keys[i]);
+            }
+        }
+        batched.multiPut(missedKeys, missedKeys);
+    }
+    end = chrono::steady_clock::now();
+    double batchedNs = chrono::duration<double, nano>(end - start).count() / numKeys;
+
+    assert(loopedValues == batchedValues);
+    cout << "batch " << batchSize << ": looped " << loopedNs << " ns/key, batched "
+         << batchedNs << " ns/key (" << loopedNs / batchedNs << "x)" << endl;
+}
+
+int main() {
+    int capacity = 2;
+    LRUCache<int, int>* cache = new LRUCache<int, int>(capacity);
+
+    vector<int> keys{1, 2};
+    cout << "cache->multiPut([1, 2], [1, 2])" << endl;
+    cache->multiPut(keys, keys);
+    cout << "cache->put(3, 3)" << endl;
+    cache->put(3, 3);
+    cache->printQueue();
+
+    keys = {1, 2, 3, 2};
+    vector<int> values(keys.size());
+    cache->multiGet(keys, values, -1);
+    cout << "cache->multiGet([1, 2, 3, 2]): [ ";
+    for (int v : values) {
+        cout << v << " ";
+    }
+    cout << "]" << endl;
+    cache->printQueue();
+    delete cache;
+    cout << endl;
+
+    // 8M entries: 128MB of slab plus 64MB of index, well beyond any L3.
+    int bigCapacity = 8 * 1024 * 1024;
+    cout << "Benchmark (capacity " << bigCapacity << ", ~80% hits):" << endl;
+    for (int batchSize : {16, 64, 256}) {
+        compare(bigCapacity, batchSize, 4 * 1024 * 1024);
+    }
+    return 0;
+}
@@ -0,0 +1,216 @@
+#include <cassert>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Weight of an entry, e.g. the size in bytes of the object the value refers to.
+typedef function<long long(int key, int value)> Weigher;
+
+// Called once for every entry that leaves the cache because of the budget.
+typedef function<void(int key, int value)> EvictionListener;
+
+// Thread-safe O(1) LRU cache (see p146v2_lru_cache.cpp) with two modes:
+// * LRUCache(capacity): every entry weighs 1, as in the original problem;
+// * LRUCache(weigher, maxWeight): the budget is the total weight of the entries,
+//   and put evicts as many LRU entries as it takes to fit the new one.
+// The weigher comes first so that the two modes cannot be mixed up: passing a
+// weigher where the eviction listener goes does not compile.
+// The weigher and the eviction listener are user code: they are always called
+// without holding the internal lock, so they may be slow or even use the cache.
+class LRUCache {
+public:
+    LRUCache(int capacity, EvictionListener listener = nullptr)
+        : _maxWeight(capacity), _weight(0), _listener(listener) {}
+
+    LRUCache(Weigher weigher, long long maxWeight, EvictionListener listener = nullptr)
+        : _maxWeight(maxWeight), _weight(0), _weigher(weigher), _listener(listener) {}
+
+    // LRUCache(100, weigher) would otherwise turn the weigher into a listener.
+    template <typename F,
+              typename enable_if<!is_void<decltype(declval<F&>()(0, 0))>::value, int>::type = 0>
+    LRUCache(int capacity, F weigher) = delete;
+
+    void put(int key, int value) {
+        long long w = _weigher ? _weigher(key, value) : 1;
+        assert(w >= 0);
+
+        vector<pair<int, int>> evicted;
+        {
+            lock_guard<mutex> lock(_mtx);
+            unordered_map<int, list<Entry>::iterator>::iterator it = _m.find(key);
+            if (w > _maxWeight) {
+                // It would not fit even in an empty cache: do not insert it, and
+                // drop the old value, which is now stale.
+                if (it != _m.end()) {
+                    evicted.emplace_back(key, it->second->value);
+                    _erase(it);
+                }
+            } else {
+                if (it != _m.end()) {
+                    // Existing key: replace the value (not an eviction) and move it
+                    // to the back of the queue.
+                    _weight += w - it->second->weight;
+                    it->second->value = value;
+                    it->second->weight = w;
+                    _q.splice(_q.end(), _q, it->second);
+                } else {
+                    _q.push_back(Entry{key, value, w});
+                    _m[key] = prev(_q.end());
+                    _weight += w;
+                }
+
+                // The new entry is at the back, and fits on its own: it is never
+                // evicted here.
+                while (_weight > _maxWeight) {
+                    Entry& lru = _q.front();
+                    evicted.emplace_back(lru.key, lru.value);
+                    _erase(_m.find(lru.key));
+                }
+            }
+            assert(_weight <= _maxWeight);
+        }
+
+        if (_listener) {
+            for (pair<int, int>& e : evicted) {
+                _listener(e.first, e.second);
+            }
+        }
+    }
+
+    int get(int key) {
+        lock_guard<mutex> lock(_mtx);
+        unordered_map<int, list<Entry>::iterator>::iterator it = _m.find(key);
+        if (it == _m.end()) {
+            // Key not in the cache.
+            return -1;
+        }
+
+        _q.splice(_q.end(), _q, it->second);
+        return it->second->value;
+    }
+
+    long long weight() {
+        lock_guard<mutex> lock(_mtx);
+        return _weight;
+    }
+
+    int size() {
+        lock_guard<mutex> lock(_mtx);
+        return _m.size();
+    }
+
+    void printQueue() {
+        lock_guard<mutex> lock(_mtx);
+        cout << "Queue (weight " << _weight << "/" << _maxWeight << "):" << endl;
+        string out = " <[ ";
+        for (Entry& e : _q) {
+            out.append("(" + to_string(e.key) + ", " + to_string(e.value) + ", w" + to_string(e.weight) + ") ");
+        }
+        out += "]<";
+        cout << out << endl;
+    }
+
+private:
+    struct Entry {
+        int key;
+        int value;
+        long long weight;
+    };
+
+    void _erase(unordered_map<int, list<Entry>::iterator>::iterator it) {
+        _weight -= it->second->weight;
+        _q.erase(it->second);
+        _m.erase(it);
+    }
+
+    long long _maxWeight;
+    long long _weight;
+    Weigher _weigher;
+    EvictionListener _listener;
+
+    mutex _mtx;
+
+    // Front is the least recently used entry, back the most recently used one.
+    list<Entry> _q;
+    unordered_map<int, list<Entry>::iterator> _m;
+};
+
+int main() {
+    // Entry-count mode behaves like the original cache.
+    LRUCache* cache = new LRUCache(2);
+    cache->put(1, 1);
+    cache->put(2, 2);
+    assert(cache->get(1) == 1);
+    cache->put(3, 3);
+    assert(cache->get(2) == -1);
+    cache->put(4, 4);
+    assert(cache->get(1) == -1);
+    assert(cache->get(3) == 3);
+    assert(cache->get(4) == 4);
+    delete cache;
+
+    // Weighted mode: the value is the size of the object, and the budget is 100.
+    vector<pair<int, int>> evicted;
+    LRUCache* weighted = nullptr;
+    weighted = new LRUCache(
+        [](int, int value) { return static_cast<long long>(value); },
+        100,
+        [&](int key, int value) {
+            cout << "  evicted (" << key << ", " << value << ")" << endl;
+            evicted.emplace_back(key, value);
+            // The listener runs outside the lock: calling back into the cache
+            // must not deadlock.
+            assert(weighted->get(key) == -1);
+        });
+
+    for (int key = 1; key <= 5; ++key) {
+        cout << "weighted->put(" << key << ", 20)" << endl;
+        weighted->put(key, 20);
+    }
+    weighted->printQueue();
+    assert(evicted.empty());
+
+    // One big entry pushes out as many LRU entries as needed.
+    cout << "weighted->get(1): " << weighted->get(1) << endl;
+    cout << "weighted->put(6, 70)" << endl;
+    weighted->put(6, 70);
+    weighted->printQueue();
+    assert((evicted == vector<pair<int, int>>{{2, 20}, {3, 20}, {4, 20}, {5, 20}}));
+    assert(weighted->weight() == 90);
+
+    // Growing an existing entry can evict others, but never itself.
+    evicted.clear();
+    cout << "weighted->put(1, 40)" << endl;
+    weighted->put(1, 40);
+    weighted->printQueue();
+    assert((evicted == vector<pair<int, int>>{{6, 70}}));
+
+    // An entry heavier than the whole budget is not cached.
+    evicted.clear();
+    cout << "weighted->put(1, 500)" << endl;
+    weighted->put(1, 500);
+    weighted->printQueue();
+    assert((evicted == vector<pair<int, int>>{{1, 40}}));
+    assert(weighted->size() == 0 && weighted->weight() == 0);
+
+    delete weighted;
+
+    // A plain int budget selects the weighted mode, and swapping the arguments
+    // does not compile.
+    Weigher byValue = [](int, int value) { return static_cast<long long>(value); };
+    static_assert(!is_constructible<LRUCache, int, Weigher>::value, "weigher taken as listener");
+    LRUCache budget(byValue, 100);
+    budget.put(1, 60);
+    budget.put(2, 60);
+    assert(budget.size() == 1 && budget.weight() == 60);
+    assert(budget.get(1) == -1 && budget.get(2) == 60);
+    return 0;
+}
@@ -0,0 +1,386 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Returns the current time in milliseconds. Injectable so that tests and
+// benchmarks can drive the time themselves.
+typedef function<uint64_t()> Clock;
+
+uint64_t steadyClockMs() {
+    return chrono::duration_cast<chrono::milliseconds>(
+        chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// O(1) LRU cache (see p146v2_lru_cache.cpp) whose entries also expire after a
+// time-to-live, either the default one given to the constructor or one given to
+// put. A TTL of 0 means that the entry never expires.
+//
+// Expired entries are removed in two ways:
+// * lazily: get never returns an expired entry, it erases it instead;
+// * by a hierarchical timer wheel, advanced by put and expire, so that expired
+//   entries that are never read again do not sit in memory until capacity
+//   eviction pushes them out.
+//
+// The wheel has LEVELS levels of SLOTS slots each. Level 0 has one slot per
+// millisecond, and every slot of level l spans a whole turn of level l - 1.
+// An entry is hashed into the lowest level whose span covers its expiration
+// time. When a level completes a turn, the next slot of the level above is
+// cascaded down, so each entry is moved at most LEVELS - 1 times before the
+// level-0 slot it ends up in is reclaimed in one go. Advancing the wheel is
+// O(1) amortized per tick, and never scans the cache. Ticks on which nothing can
+// happen (the lower levels are empty) are skipped in bulk, so a long idle gap
+// costs at most a few steps per turn of the levels that hold timers.
+class LRUCache {
+public:
+    LRUCache(int capacity, uint64_t defaultTtlMs = 0, Clock clock = steadyClockMs)
+        : _capacity(capacity), _defaultTtlMs(defaultTtlMs), _clock(clock) {
+        _m.reserve(capacity);
+        _wheelTime = _clock();
+        for (int l = 0; l < LEVELS; ++l) {
+            fill(_wheel[l], _wheel[l] + SLOTS, nullptr);
+            _numTimers[l] = 0;
+        }
+    }
+
+    void put(int key, int value) {
+        put(key, value, _defaultTtlMs);
+    }
+
+    void put(int key, int value, uint64_t ttlMs) {
+        uint64_t now = _clock();
+        _advance(now);
+        if (_capacity <= 0) {
+            return;
+        }
+
+        unordered_map<int, list<Entry>::iterator>::iterator it = _m.find(key);
+        list<Entry>::iterator lIt;
+        if (it != _m.end()) {
+            // Existing key: update the value and move it to the back of the queue.
+            lIt = it->second;
+            _unschedule(&*lIt);
+            _q.splice(_q.end(), _q, lIt);
+        } else {
+            if (_m.size() == _capacity) {
+                _erase(_q.begin());
+            }
+            _q.emplace_back();
+            lIt = prev(_q.end());
+            lIt->key = key;
+            _m[key] = lIt;
+        }
+
+        lIt->value = value;
+        lIt->expiresAt = ttlMs > 0 ? now + ttlMs : NEVER;
+        _schedule(&*lIt);
+    }
+
+    // Does not advance the wheel, so that hits never pay for reclaiming other
+    // entries.
+    int get(int key) {
+        uint64_t now = _clock();
+        unordered_map<int, list<Entry>::iterator>::iterator it = _m.find(key);
+        if (it == _m.end()) {
+            // Key not in the cache.
+            return -1;
+        }
+
+        list<Entry>::iterator lIt = it->second;
+        if (lIt->expiresAt <= now) {
+            // Expired, but its wheel slot has not been reclaimed yet.
+            _erase(lIt);
+            return -1;
+        }
+
+        _q.splice(_q.end(), _q, lIt);
+        return lIt->value;
+    }
+
+    // Reclaims all the entries that expired since the last put or expire.
+    // Call it periodically if the cache can go a long time without writes.
+    void expire() {
+        _advance(_clock());
+    }
+
+    int size() const {
+        return _m.size();
+    }
+
+    void printQueue() {
+        cout << "Queue:" << endl;
+        string out = " <[ ";
+        for (Entry& e : _q) {
+            out.append("(" + to_string(e.key) + ", " + to_string(e.value) + ") ");
+        }
+        out += "]<";
+        cout << out << endl;
+    }
+
+private:
+    static constexpr int LEVELS = 4;
+    static constexpr int SLOT_BITS = 6;
+    static constexpr int SLOTS = 1 << SLOT_BITS;
+    static constexpr uint64_t NEVER = ~0ull;
+
+    // Span of the whole wheel: SLOTS^LEVELS ms, about 4.6 hours. Entries that
+    // expire later are parked in the last level and rescheduled when cascaded.
+    static constexpr uint64_t HORIZON = 1ull << (SLOT_BITS * LEVELS);
+
+    struct Entry {
+        int key;
+        int value;
+        uint64_t expiresAt;
+
+        // Links of the intrusive list of the wheel slot the entry is in, and the
+        // head of that list (nullptr if the entry is not scheduled).
+        Entry* timerPrev = nullptr;
+        Entry* timerNext = nullptr;
+        Entry** timerSlot = nullptr;
+    };
+
+    void _schedule(Entry* e) {
+        if (e->expiresAt == NEVER) {
+            return;
+        }
+
+        // An entry cascaded on the very tick it is due lands in the current
+        // level-0 slot, which _advance reclaims right after the cascade.
+        uint64_t at = max(e->expiresAt, _wheelTime);
+        uint64_t delta = at - _wheelTime;
+        if (delta >= HORIZON) {
+            at = _wheelTime + HORIZON - 1;
+            delta = HORIZON - 1;
+        }
+
+        int level = 0;
+        while (delta >= (1ull << (SLOT_BITS * (level + 1)))) {
+            ++level;
+        }
+        Entry** slot = &_wheel[level][(at >> (SLOT_BITS * level)) & (SLOTS - 1)];
+        ++_numTimers[level];
+
+        e->timerSlot = slot;
+        e->timerPrev = nullptr;
+        e->timerNext = *slot;
+        if (*slot != nullptr) {
+            (*slot)->timerPrev = e;
+        }
+        *slot = e;
+    }
+
+    void _unschedule(Entry* e) {
+        if (e->timerSlot == nullptr) {
+            return;
+        }
+        if (e->timerPrev != nullptr) {
+            e->timerPrev->timerNext = e->timerNext;
+        } else {
+            *e->timerSlot = e->timerNext;
+        }
+        if (e->timerNext != nullptr) {
+            e->timerNext->timerPrev = e->timerPrev;
+        }
+        --_numTimers[(e->timerSlot - &_wheel[0][0]) / SLOTS];
+        e->timerSlot = nullptr;
+    }
+
+    // Moves the wheel forward to now, one tick at a time, cascading the upper
+    // levels and reclaiming the level-0 slot of every tick.
+    void _advance(uint64_t now) {
+        while (_wheelTime < now) {
+            int lowest = 0;
+            while (lowest < LEVELS && _numTimers[lowest] == 0) {
+                ++lowest;
+            }
+            if (lowest == LEVELS) {
+                // No timer scheduled: jump straight to now.
+                _wheelTime = now;
+                break;
+            }
+            if (lowest > 0) {
+                // The levels below are empty: nothing happens until the next
+                // slot of level lowest is cascaded.
+                uint64_t span = 1ull << (SLOT_BITS * lowest);
+                uint64_t nextCascade = (_wheelTime / span + 1) * span;
+                if (nextCascade > now) {
+                    _wheelTime = now;
+                    break;
+                }
+                _wheelTime = nextCascade - 1;
+            }
+
+            ++_wheelTime;
+            for (int l = 1; l < LEVELS; ++l) {
+                if ((_wheelTime & ((1ull << (SLOT_BITS * l)) - 1)) != 0) {
+                    break;
+                }
+                _cascade(l, (_wheelTime >> (SLOT_BITS * l)) & (SLOTS - 1));
+            }
+
+            Entry** slot = &_wheel[0][_wheelTime & (SLOTS - 1)];
+            while (*slot != nullptr) {
+                Entry* e = *slot;
+                assert(e->expiresAt <= _wheelTime);
+                _erase(_m[e->key]);
+            }
+        }
+    }
+
+    void _cascade(int level, int slotIdx) {
+        Entry* e = _wheel[level][slotIdx];
+        _wheel[level][slotIdx] = nullptr;
+        while (e != nullptr) {
+            Entry* next = e->timerNext;
+            --_numTimers[level];
+            _schedule(e);
+            e = next;
+        }
+    }
+
+    void _erase(list<Entry>::iterator lIt) {
+        _unschedule(&*lIt);
+        _m.erase(lIt->key);
+        _q.erase(lIt);
+    }
+
+    int _capacity;
+    uint64_t _defaultTtlMs;
+    Clock _clock;
+
+    // Front is the least recently used entry, back the most recently used one.
+    list<Entry> _q;
+    unordered_map<int, list<Entry>::iterator> _m;
+
+    // Time of the last reclaimed level-0 slot.
+    uint64_t _wheelTime;
+    Entry* _wheel[LEVELS][SLOTS];
+
+    // Entries scheduled in each level.
+    int _numTimers[LEVELS];
+};
+
+// Simulates a cache with a stream of short-lived entries expiring at
+// expirationsPerSec (in simulated time), and a small set of hot entries without
+// TTL that are read in between. Prints the distribution of the hit latency of
+// the hot reads.
+void benchmark(int expirationsPerSec, int seconds) {
+    uint64_t fakeNow = 0;
+    int capacity = 4000000;
+    LRUCache cache(capacity, 1000, [&]() { return fakeNow; });
+
+    int numHot = 10000;
+    for (int k = 0; k < numHot; ++k) {
+        cache.put(k, k, 0);
+    }
+
+    // Each ms: insert expirationsPerSec / 1000 short-lived entries, each living
+    // 1s, and read as many hot keys.
+    int perMs = expirationsPerSec / 1000;
+    int nextKey = numHot;
+    vector<double> latencies;
+    latencies.reserve(static_cast<size_t>(seconds) * 1000 * perMs);
+    long long checksum = 0;
+    for (int ms = 0; ms < seconds * 1000; ++ms) {
+        ++fakeNow;
+        for (int i = 0; i < perMs; ++i) {
+            cache.put(nextKey++, i);
+        }
+        for (int i = 0; i < max(perMs, 100); ++i) {
+            int key = (ms * 7919 + i * 104729) % numHot;
+            auto start = chrono::steady_clock::now();
+            checksum += cache.get(key);
+            auto end = chrono::steady_clock::now();
+            latencies.push_back(chrono::duration<double, nano>(end - start).count());
+        }
+    }
+    assert(cache.size() <= numHot + expirationsPerSec + perMs);
+
+    sort(latencies.begin(), latencies.end());
+    cout << expirationsPerSec << " expirations/s, size " << cache.size()
+         << ": hit p50 " << latencies[latencies.size() / 2]
+         << " ns, p99 " << latencies[latencies.size() * 99 / 100]
+         << " ns, p99.9 " << latencies[latencies.size() * 999 / 1000]
+         << " ns (checksum " << checksum << ")" << endl;
+}
+
+int main() {
+    uint64_t fakeNow = 0;
+    LRUCache* cache = new LRUCache(3, 100, [&]() { return fakeNow; });
+
+    cout << "cache->put(1, 1) with the default TTL of 100ms" << endl;
+    cache->put(1, 1);
+    cout << "cache->put(2, 2, 5000)" << endl;
+    cache->put(2, 2, 5000);
+    cout << "cache->put(3, 3, 0) (never expires)" << endl;
+    cache->put(3, 3, 0);
+    cache->printQueue();
+
+    fakeNow = 99;
+    cout << "t=99ms cache->get(1): " << cache->get(1) << endl;
+    assert(cache->get(1) == 1);
+
+    // Lazy: reading an expired entry erases it.
+    fakeNow = 100;
+    cout << "t=100ms cache->get(1): " << cache->get(1) << endl;
+    assert(cache->get(1) == -1);
+    assert(cache->size() == 2);
+
+    // The wheel reclaims entries that are never read again.
+    fakeNow = 10000;
+    cout << "t=10s cache->expire()" << endl;
+    cache->expire();
+    cache->printQueue();
+    assert(cache->size() == 1);
+    cout << "cache->put(4, 4)" << endl;
+    cache->put(4, 4);
+    assert(cache->size() == 2);
+    assert(cache->get(3) == 3);
+
+    // Entries beyond the wheel horizon survive cascades until they are due.
+    cout << "cache->put(5, 5, 10h)" << endl;
+    cache->put(5, 5, 10ull * 3600 * 1000);
+    fakeNow += 10ull * 3600 * 1000 - 1;
+    assert(cache->get(5) == 5);
+    fakeNow += 1;
+    cache->put(6, 6, 0);
+    cache->printQueue();
+    assert(cache->size() == 2);
+    delete cache;
+
+    // Long idle gaps: a year without timers, then a year with one timer far
+    // away, must not walk the wheel one millisecond at a time.
+    uint64_t year = 365ull * 24 * 3600 * 1000;
+    LRUCache idle(10, 0, [&]() { return fakeNow; });
+    idle.put(1, 1);
+    auto start = chrono::steady_clock::now();
+    fakeNow += year;
+    idle.put(2, 2);
+    idle.put(3, 3, year);
+    fakeNow += year - 1;
+    idle.expire();
+    assert(idle.get(3) == 3);
+    fakeNow += 1;
+    idle.expire();
+    assert(idle.size() == 2 && idle.get(1) == 1);
+    double idleMs = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    cout << "Two idle years advanced in " << idleMs << " ms" << endl;
+    assert(idleMs < 1000);
+    cout << endl;
+
+    // Hit latency should not depend on the expiration rate.
+    cout << "Benchmark (10K hot keys without TTL, short-lived entries with a 1s TTL):" << endl;
+    for (int rate : {0, 100000, 1000000}) {
+        benchmark(rate, 3);
+    }
+    return 0;
+}
@@ -0,0 +1,300 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Replacement policy of the cache, chosen per deployment.
+enum class Mode {
+    // Exact LRU: every hit moves the entry to the back of the recency list.
+    LRU,
+    // CLOCK (second chance): a hit only sets the reference bit of the entry.
+    // To evict, a hand sweeps the entries in a circle, clearing the bits it finds
+    // set and evicting the first entry whose bit was already clear.
+    CLOCK,
+};
+
+// Thread-safe cache with the get/put interface of LRUCache and a selectable
+// replacement policy. Both modes share the same slab of entries and the same
+// key index.
+//
+// In CLOCK mode a hit does not touch the shared structure at all (only a
+// per-entry bit, and only if it is not already set), so get runs under a shared
+// lock and readers proceed in parallel. In LRU mode a hit relinks the recency
+// list and needs the exclusive lock.
+class LRUCache {
+public:
+    LRUCache(int capacity, Mode mode = Mode::LRU)
+        : _capacity(capacity), _mode(mode), _size(0), _head(NIL), _tail(NIL), _hand(0),
+          _nodes(capacity), _referenced(new atomic<uint8_t>[capacity]) {
+        _m.reserve(capacity);
+        for (int i = 0; i < capacity; ++i) {
+            _referenced[i].store(0, memory_order_relaxed);
+        }
+    }
+
+    int get(int key) {
+        if (_mode == Mode::CLOCK) {
+            shared_lock<shared_mutex> lock(_mtx);
+            unordered_map<int, int>::const_iterator it = _m.find(key);
+            if (it == _m.end()) {
+                return -1;
+            }
+            // Skip the store if the bit is already set, so that hot entries do not
+            // keep bouncing their cache line between cores.
+            atomic<uint8_t>& ref = _referenced[it->second];
+            if (ref.load(memory_order_relaxed) == 0) {
+                ref.store(1, memory_order_relaxed);
+            }
+            return _nodes[it->second].value;
+        }
+
+        unique_lock<shared_mutex> lock(_mtx);
+        unordered_map<int, int>::iterator it = _m.find(key);
+        if (it == _m.end()) {
+            return -1;
+        }
+        _reEnqueue(it->second);
+        return _nodes[it->second].value;
+    }
+
+    void put(int key, int value) {
+        if (_capacity <= 0) {
+            return;
+        }
+
+        unique_lock<shared_mutex> lock(_mtx);
+        unordered_map<int, int>::iterator it = _m.find(key);
+        if (it != _m.end()) {
+            _nodes[it->second].value = value;
+            if (_mode == Mode::CLOCK) {
+                _referenced[it->second].store(1, memory_order_relaxed);
+            } else {
+                _reEnqueue(it->second);
+            }
+            return;
+        }
+
+        int idx;
+        if (_size < _capacity) {
+            idx = _size++;
+        } else {
+            idx = _mode == Mode::CLOCK ? _sweep() : _head;
+            _m.erase(_nodes[idx].key);
+        }
+
+        _nodes[idx].key = key;
+        _nodes[idx].value = value;
+        if (_mode == Mode::CLOCK) {
+            _referenced[idx].store(0, memory_order_relaxed);
+        } else {
+            if (idx == _head) {
+                _unlink(idx);
+            }
+            _pushBack(idx);
+        }
+        _m[key] = idx;
+    }
+
+private:
+    static constexpr int NIL = -1;
+
+    struct Node {
+        int key;
+        int value;
+        // Recency links, only used in LRU mode.
+        int prev;
+        int next;
+    };
+
+    // Advances the hand to the next entry without a second chance, and returns it.
+    // The hand then moves past it, so the new entry is the last one it revisits.
+    int _sweep() {
+        while (_referenced[_hand].load(memory_order_relaxed) != 0) {
+            _referenced[_hand].store(0, memory_order_relaxed);
+            _hand = (_hand + 1) % _capacity;
+        }
+        int victim = _hand;
+        _hand = (_hand + 1) % _capacity;
+        return victim;
+    }
+
+    void _unlink(int idx) {
+        Node& n = _nodes[idx];
+        if (n.prev != NIL) {
+            _nodes[n.prev].next = n.next;
+        } else {
+            _head = n.next;
+        }
+        if (n.next != NIL) {
+            _nodes[n.next].prev = n.prev;
+        } else {
+            _tail = n.prev;
+        }
+    }
+
+    void _pushBack(int idx) {
+        Node& n = _nodes[idx];
+        n.prev = _tail;
+        n.next = NIL;
+        if (_tail != NIL) {
+            _nodes[_tail].next = idx;
+        } else {
+            _head = idx;
+        }
+        _tail = idx;
+    }
+
+    void _reEnqueue(int idx) {
+        if (idx != _tail) {
+            _unlink(idx);
+            _pushBack(idx);
+        }
+    }
+
+    int _capacity;
+    Mode _mode;
+    int _size;
+
+    // LRU mode: front (least recently used) and back of the recency list.
+    int _head;
+    int _tail;
+
+    // CLOCK mode: next entry to be examined for eviction.
+    int _hand;
+
+    shared_mutex _mtx;
+    vector<Node> _nodes;
+    unique_ptr<atomic<uint8_t>[]> _referenced;
+
+    // Maps a key to its index in the slab.
+    unordered_map<int, int> _m;
+};
+
+struct XorShift {
+    uint64_t s;
+    XorShift(uint64_t seed) : s(seed) {}
+    uint64_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+vector<int> zipfTrace(int numKeys, double theta, int length, uint64_t seed) {
+    vector<double> cdf(numKeys);
+    double sum = 0.0;
+    for (int k = 0; k < numKeys; ++k) {
+        sum += 1.0 / pow(k + 1, theta);
+        cdf[k] = sum;
+    }
+    XorShift rng(seed);
+    vector<int> trace(length);
+    for (int& key : trace) {
+        double u = (rng.next() >> 11) * (1.0 / 9007199254740992.0) * sum;
+        key = lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+    }
+    return trace;
+}
+
+// Zipfian accesses interrupted by one-off sequential scans over cold keys.
+vector<int> zipfWithScansTrace(int numKeys, int length) {
+    vector<int> trace = zipfTrace(numKeys, 0.99, length, 7);
+    int scanKey = numKeys;
+    for (int i = 0; i + 20000 <= length; i += 100000) {
+        for (int j = i; j < i + 20000; ++j) {
+            trace[j] = scanKey++;
+        }
+    }
+    return trace;
+}
+
+// A loop over slightly more keys than fit in the cache: the worst case of LRU.
+vector<int> loopTrace(int numKeys, int length) {
+    vector<int> trace(length);
+    for (int i = 0; i < length; ++i) {
+        trace[i] = i % numKeys;
+    }
+    return trace;
+}
+
+// One key per line, e.g. extracted from production logs.
+vector<int> readTrace(string const & path) {
+    vector<int> trace;
+    ifstream in(path);
+    int key;
+    while (in >> key) {
+        trace.push_back(key);
+    }
+    return trace;
+}
+
+// Replays a trace as a read-through cache (get, and put on a miss).
+void replay(string const & name, vector<int> const & trace, int capacity) {
+    cout << name << " (" << trace.size() << " requests, capacity " << capacity << "):" << endl;
+    for (Mode mode : {Mode::LRU, Mode::CLOCK}) {
+        LRUCache cache(capacity, mode);
+        long long hits = 0;
+        auto start = chrono::steady_clock::now();
+        for (int key : trace) {
+            if (cache.get(key) != -1) {
+                ++hits;
+            } else {
+                cache.put(key, key);
+            }
+        }
+        auto end = chrono::steady_clock::now();
+        cout << "  " << (mode == Mode::LRU ? "LRU:  " : "CLOCK:") << " hit ratio "
+             << 100.0 * hits / trace.size() << "%, "
+             << chrono::duration<double, nano>(end - start).count() / trace.size() << " ns/op" << endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    int capacity = 2;
+    LRUCache* cache = new LRUCache(capacity, Mode::CLOCK);
+
+    cout << "cache->put(1, 1)" << endl;
+    cache->put(1, 1);
+    cout << "cache->put(2, 2)" << endl;
+    cache->put(2, 2);
+    cout << "cache->get(1): " << cache->get(1) << endl;
+    cout << "cache->put(3, 3)" << endl;
+    cache->put(3, 3);
+    // 1 had a second chance: 2 is evicted, as it would be with exact LRU.
+    cout << "cache->get(2): " << cache->get(2) << endl;
+    assert(cache->get(2) == -1);
+    assert(cache->get(1) == 1);
+    assert(cache->get(3) == 3);
+    delete cache;
+    cout << endl;
+
+    if (argc > 1) {
+        // Recorded traces: p146v8_lru_cache_clock <capacity> <trace file>...
+        int traceCapacity = stoi(argv[1]);
+        for (int i = 2; i < argc; ++i) {
+            replay(argv[i], readTrace(argv[i]), traceCapacity);
+        }
+        return 0;
+    }
+
+    int length = 5000000;
+    replay("Zipf 0.99 over 1M keys", zipfTrace(1000000, 0.99, length, 1), 100000);
+    replay("Zipf 0.8 over 1M keys", zipfTrace(1000000, 0.8, length, 2), 100000);
+    replay("Zipf 0.99 with scans", zipfWithScansTrace(1000000, length), 100000);
+    replay("Loop over 110K keys", loopTrace(110000, length), 100000);
+    return 0;
+}
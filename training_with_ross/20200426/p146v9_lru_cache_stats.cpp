@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Point-in-time copy of the counters of a cache.
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t inserts = 0;
+    uint64_t updates = 0;
+    uint64_t evictions = 0;
+    uint64_t size = 0;
+    uint64_t peakSize = 0;
+
+    double hitRatio() const {
+        uint64_t lookups = hits + misses;
+        return lookups == 0 ? 0.0 : static_cast<double>(hits) / lookups;
+    }
+
+    string toString() const {
+        ostringstream out;
+        out << "hits=" << hits << " misses=" << misses << " hitRatio=" << hitRatio()
+            << " inserts=" << inserts << " updates=" << updates << " evictions=" << evictions
+            << " size=" << size << " peakSize=" << peakSize;
+        return out.str();
+    }
+
+    string toJson() const {
+        ostringstream out;
+        out << "{\"hits\":" << hits << ",\"misses\":" << misses << ",\"hitRatio\":" << hitRatio()
+            << ",\"inserts\":" << inserts << ",\"updates\":" << updates
+            << ",\"evictions\":" << evictions << ",\"size\":" << size
+            << ",\"peakSize\":" << peakSize << "}";
+        return out.str();
+    }
+};
+
+// Live counters of one shard. They are only written under the lock of the shard,
+// so a plain load + store is enough (no read-modify-write): the atomics are only
+// there so that snapshot can read them from another thread at any time.
+// The slot has its own cache lines, so shards never share counter lines.
+struct alignas(64) StatsSlot {
+    atomic<uint64_t> hits{0};
+    atomic<uint64_t> misses{0};
+    atomic<uint64_t> inserts{0};
+    atomic<uint64_t> updates{0};
+    atomic<uint64_t> evictions{0};
+    atomic<uint64_t> size{0};
+    atomic<uint64_t> peakSize{0};
+
+    static void inc(atomic<uint64_t>& counter) {
+        counter.store(counter.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+
+    void addTo(CacheStats& s) const {
+        s.hits += hits.load(memory_order_relaxed);
+        s.misses += misses.load(memory_order_relaxed);
+        s.inserts += inserts.load(memory_order_relaxed);
+        s.updates += updates.load(memory_order_relaxed);
+        s.evictions += evictions.load(memory_order_relaxed);
+        s.size += size.load(memory_order_relaxed);
+        s.peakSize += peakSize.load(memory_order_relaxed);
+    }
+};
+
+// O(1) LRU cache from p146v2_lru_cache.cpp. put tells what it did, so that the
+// caller can count it.
+class LRUCache {
+public:
+    // DROPPED: nothing stored (zero capacity), nothing to count.
+    enum PutResult { UPDATED, INSERTED, EVICTED, DROPPED };
+
+    LRUCache(int capacity) : _capacity(capacity) {
+        _m.reserve(capacity);
+    }
+
+    PutResult put(int key, int value) {
+        if (_capacity <= 0) {
+            return DROPPED;
+        }
+
+        unordered_map<int, list<pair<int, int>>::iterator>::iterator it = _m.find(key);
+        if (it != _m.end()) {
+            it->second->second = value;
+            _reEnqueue(it->second);
+            return UPDATED;
+        }
+
+        if (_m.size() == _capacity) {
+            list<pair<int, int>>::iterator lru = _q.begin();
+            _m.erase(lru->first);
+            lru->first = key;
+            lru->second = value;
+            _reEnqueue(lru);
+            _m[key] = lru;
+            return EVICTED;
+        }
+        _q.emplace_back(key, value);
+        _m[key] = prev(_q.end());
+        return INSERTED;
+    }
+
+    int get(int key) {
+        unordered_map<int, list<pair<int, int>>::iterator>::iterator it = _m.find(key);
+        if (it == _m.end()) {
+            return -1;
+        }
+
+        _reEnqueue(it->second);
+        return it->second->second;
+    }
+
+    int size() const {
+        return _m.size();
+    }
+
+private:
+    void _reEnqueue(list<pair<int, int>>::iterator it) {
+        _q.splice(_q.end(), _q, it);
+    }
+
+    int _capacity;
+    list<pair<int, int>> _q;
+    unordered_map<int, list<pair<int, int>>::iterator> _m;
+};
+
+// Sharded LRU cache of p146v3_lru_cache_sharded.cpp, with a statistics slot in
+// every shard. STATS = false compiles the counters out, to measure their cost.
+//
+// size is exact; peakSize is the sum of the peaks of the shards, which is an
+// upper bound of the peak of the whole cache (shards do not peak together).
+template <bool STATS = true>
+class ShardedLRUCache {
+public:
+    ShardedLRUCache(int capacity, int numShards = 16) : _numShards(numShards) {
+        _shards.reserve(numShards);
+        for (int i = 0; i < numShards; ++i) {
+            int slice = capacity / numShards + (i < capacity % numShards ? 1 : 0);
+            _shards.emplace_back(new Shard(slice));
+        }
+    }
+
+    void put(int key, int value) {
+        Shard& shard = _shardFor(key);
+        lock_guard<mutex> lock(shard.mtx);
+        LRUCache::PutResult result = shard.cache.put(key, value);
+        if (STATS) {
+            StatsSlot& s = shard.stats;
+            if (result == LRUCache::DROPPED) {
+                // A zero-capacity shard stores nothing.
+            } else if (result == LRUCache::UPDATED) {
+                StatsSlot::inc(s.updates);
+            } else {
+                StatsSlot::inc(s.inserts);
+                if (result == LRUCache::EVICTED) {
+                    StatsSlot::inc(s.evictions);
+                } else {
+                    uint64_t size = s.size.load(memory_order_relaxed) + 1;
+                    s.size.store(size, memory_order_relaxed);
+                    if (size > s.peakSize.load(memory_order_relaxed)) {
+                        s.peakSize.store(size, memory_order_relaxed);
+                    }
+                }
+            }
+        }
+    }
+
+    int get(int key) {
+        Shard& shard = _shardFor(key);
+        lock_guard<mutex> lock(shard.mtx);
+        int value = shard.cache.get(key);
+        if (STATS) {
+            StatsSlot::inc(value != -1 ? shard.stats.hits : shard.stats.misses);
+        }
+        return value;
+    }
+
+    // Sums the slots of all the shards. No lock is taken: the counters of
+    // different shards may be a few operations apart.
+    CacheStats snapshot() const {
+        CacheStats s;
+        for (unique_ptr<Shard> const & shard : _shards) {
+            shard->stats.addTo(s);
+        }
+        return s;
+    }
+
+private:
+    struct alignas(64) Shard {
+        Shard(int capacity) : cache(capacity) {}
+        mutex mtx;
+        LRUCache cache;
+        StatsSlot stats;
+    };
+
+    Shard& _shardFor(int key) {
+        uint32_t h = static_cast<uint32_t>(key) * 0x9E3779B1u;
+        return *_shards[(h >> 16) % _numShards];
+    }
+
+    int _numShards;
+    vector<unique_ptr<Shard>> _shards;
+};
+
+struct XorShift {
+    uint64_t s;
+    XorShift(uint64_t seed) : s(seed) {}
+    uint64_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+// Sum of all the values read, printed at the end so that the compiler cannot
+// drop the benchmark loops.
+static long long checksum = 0;
+
+// Read-through workload (get, and put on a miss) over Zipfian keys.
+// Returns ns per operation.
+template <bool STATS>
+double benchmark(vector<int> const & keys, int capacity, CacheStats* stats) {
+    ShardedLRUCache<STATS> cache(capacity);
+    auto start = chrono::steady_clock::now();
+    for (int key : keys) {
+        int value = cache.get(key);
+        if (value == -1) {
+            cache.put(key, key);
+        }
+        checksum += value;
+    }
+    auto end = chrono::steady_clock::now();
+    if (stats != nullptr) {
+        *stats = cache.snapshot();
+    }
+    return chrono::duration<double, nano>(end - start).count() / keys.size();
+}
+
+int main() {
+    ShardedLRUCache<>* cache = new ShardedLRUCache<>(2, 1);
+    cache->put(1, 1);
+    cache->put(2, 2);
+    cache->get(1);
+    cache->put(3, 3);
+    cache->get(2);
+    cache->put(3, 30);
+    cout << cache->snapshot().toString() << endl;
+    cout << cache->snapshot().toJson() << endl;
+
+    CacheStats s = cache->snapshot();
+    assert(s.hits == 1 && s.misses == 1);
+    assert(s.inserts == 3 && s.updates == 1 && s.evictions == 1);
+    assert(s.size == 2 && s.peakSize == 2);
+    delete cache;
+
+    // 2 entries over 16 shards: 14 shards have no capacity, and their puts are
+    // neither inserts nor evictions.
+    ShardedLRUCache<> tiny(2, 16);
+    for (int key = 0; key < 100; ++key) {
+        tiny.put(key, key);
+    }
+    CacheStats t = tiny.snapshot();
+    assert(t.size <= 2 && t.inserts - t.evictions == t.size);
+    assert(t.inserts < 100);
+    cout << "ShardedLRUCache(2, 16): " << t.toString() << endl;
+    cout << endl;
+
+    // Overhead of the counters on the hot path.
+    int numKeys = 1000000;
+    vector<double> cdf(numKeys);
+    double sum = 0.0;
+    for (int k = 0; k < numKeys; ++k) {
+        sum += 1.0 / pow(k + 1, 0.99);
+        cdf[k] = sum;
+    }
+    XorShift rng(1);
+    vector<int> keys(5000000);
+    for (int& key : keys) {
+        double u = (rng.next() >> 11) * (1.0 / 9007199254740992.0) * sum;
+        key = lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+    }
+
+    // This is memory-bound and noisy: alternate the runs and compare the
+    // medians.
+    int numRuns = 11;
+    vector<double> times[2];
+    CacheStats stats;
+    for (int run = 0; run < numRuns; ++run) {
+        times[0].push_back(benchmark<false>(keys, 100000, nullptr));
+        times[1].push_back(benchmark<true>(keys, 100000, &stats));
+    }
+    double median[2];
+    for (int i = 0; i < 2; ++i) {
+        sort(times[i].begin(), times[i].end());
+        median[i] = times[i][numRuns / 2];
+    }
+    cout << "Benchmark (Zipf 0.99, capacity 100000, read-through, median of " << numRuns << " runs):" << endl;
+    cout << "  " << stats.toString() << endl;
+    cout << "  without stats: " << median[0] << " ns/op (min " << times[0][0] << ", max " << times[0].back() << ")" << endl;
+    cout << "  with stats:    " << median[1] << " ns/op (min " << times[1][0] << ", max " << times[1].back()
+         << "), overhead " << 100.0 * (median[1] - median[0]) / median[0] << "%" << endl;
+    cout << "  (checksum " << checksum << ")" << endl;
+    return 0;
+}
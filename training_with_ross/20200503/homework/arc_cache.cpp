@@ -0,0 +1,447 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Adaptive Replacement Cache (Megiddo and Modha, FAST 2003).
+//
+// The cached entries are split in two LRU lists:
+// * T1: entries seen once since they entered the cache (recency);
+// * T2: entries hit at least once more (frequency).
+// Each list has a ghost list (B1, B2) remembering the keys, without values, of
+// the entries it recently evicted. A miss on a ghost key means that the list
+// it was evicted from was too small: a B1 hit grows the target size p of T1, a
+// B2 hit shrinks it. The victim comes from T1 when T1 is above p, from T2
+// otherwise. A scan only goes through T1, so it can never flush T2, and a new
+// hot set moves into T2 as soon as its keys are hit twice.
+//
+// All the lists are std::list splices and the index is one hash map over the
+// four lists, so every operation is O(1). The ghost lists hold up to capacity
+// keys in total.
+class ARCCache {
+public:
+    ARCCache(int capacity) : _capacity(capacity), _p(0) {
+        _index.reserve(2 * capacity);
+    }
+
+    int get(int key) {
+        unordered_map<int, Location>::iterator it = _index.find(key);
+        if (it == _index.end() || it->second.id >= B1) {
+            // Cache miss. A ghost hit only adapts p when the caller puts the value.
+            return -1;
+        }
+
+        _moveTo(it->second, T2);
+        return it->second.it->value;
+    }
+
+    void put(int key, int value) {
+        if (_capacity <= 0) {
+            return;
+        }
+
+        unordered_map<int, Location>::iterator it = _index.find(key);
+        if (it != _index.end() && it->second.id < B1) {
+            // Cached: update the value, and count it as a hit.
+            it->second.it->value = value;
+            _moveTo(it->second, T2);
+            return;
+        }
+
+        if (it != _index.end()) {
+            // Ghost hit: adapt the target size of T1, make room, and bring the key
+            // back straight into T2.
+            Location& loc = it->second;
+            int b1 = _lists[B1].size();
+            int b2 = _lists[B2].size();
+            if (loc.id == B1) {
+                _p = min(_capacity, _p + max(b2 / b1, 1));
+            } else {
+                _p = max(0, _p - max(b1 / b2, 1));
+            }
+            _replace(loc.id == B2);
+            loc.it->value = value;
+            _moveTo(loc, T2);
+            return;
+        }
+
+        // New key.
+        int l1 = _lists[T1].size() + _lists[B1].size();
+        int total = l1 + _lists[T2].size() + _lists[B2].size();
+        if (l1 == _capacity) {
+            if (_lists[T1].size() < _capacity) {
+                _dropLru(B1);
+                _replace(false);
+            } else {
+                // B1 is empty and T1 is the whole cache: evict from T1 directly.
+                _dropLru(T1);
+            }
+        } else if (total >= _capacity) {
+            if (total == 2 * _capacity) {
+                _dropLru(B2);
+            }
+            _replace(false);
+        }
+
+        list<Entry>& t1 = _lists[T1];
+        t1.push_back(Entry{key, value});
+        _index[key] = Location{T1, prev(t1.end())};
+    }
+
+    // Target size of T1, exposed to show the adaptation.
+    int target() const {
+        return _p;
+    }
+
+private:
+    enum ListId { T1, T2, B1, B2 };
+
+    struct Entry {
+        int key;
+        int value;
+    };
+
+    struct Location {
+        ListId id;
+        list<Entry>::iterator it;
+    };
+
+    // Moves the entry to the most recently used end of the given list.
+    void _moveTo(Location& loc, ListId to) {
+        list<Entry>& dst = _lists[to];
+        dst.splice(dst.end(), _lists[loc.id], loc.it);
+        loc.id = to;
+    }
+
+    // Forgets the least recently used key of the list.
+    void _dropLru(ListId id) {
+        list<Entry>& l = _lists[id];
+        _index.erase(l.front().key);
+        l.pop_front();
+    }
+
+    // Evicts one cached entry into its ghost list, if the cache is full. The
+    // victim is the LRU of T1 if T1 is above its target (or at it, when the
+    // request that caused the eviction is a B2 ghost), else the LRU of T2.
+    void _replace(bool inB2) {
+        int t1 = _lists[T1].size();
+        if (t1 + static_cast<int>(_lists[T2].size()) < _capacity) {
+            return;
+        }
+        ListId from = (t1 > 0 && (t1 > _p || (inB2 && t1 == _p))) ? T1 : T2;
+        ListId to = from == T1 ? B1 : B2;
+        list<Entry>& src = _lists[from];
+        Location& loc = _index[src.front().key];
+        _moveTo(loc, to);
+    }
+
+    int _capacity;
+
+    // Target size of T1, between 0 and capacity.
+    int _p;
+
+    // T1, T2, B1, B2, each least recently used first.
+    list<Entry> _lists[4];
+
+    // Maps every key of the four lists to its list and position.
+    unordered_map<int, Location> _index;
+};
+
+// O(1) LRUCache of p146v2_lru_cache.cpp.
+class LRUCache {
+public:
+    LRUCache(int capacity) : _capacity(capacity) {
+        _m.reserve(capacity);
+    }
+
+    int get(int key) {
+        unordered_map<int, list<pair<int, int>>::iterator>::iterator it = _m.find(key);
+        if (it == _m.end()) {
+            return -1;
+        }
+        _q.splice(_q.end(), _q, it->second);
+        return it->second->second;
+    }
+
+    void put(int key, int value) {
+        if (_capacity <= 0) {
+            return;
+        }
+        unordered_map<int, list<pair<int, int>>::iterator>::iterator it = _m.find(key);
+        if (it != _m.end()) {
+            it->second->second = value;
+            _q.splice(_q.end(), _q, it->second);
+            return;
+        }
+        if (_m.size() == _capacity) {
+            list<pair<int, int>>::iterator lru = _q.begin();
+            _m.erase(lru->first);
+            lru->first = key;
+            lru->second = value;
+            _q.splice(_q.end(), _q, lru);
+            _m[key] = lru;
+            return;
+        }
+        _q.emplace_back(key, value);
+        _m[key] = prev(_q.end());
+    }
+
+private:
+    int _capacity;
+    list<pair<int, int>> _q;
+    unordered_map<int, list<pair<int, int>>::iterator> _m;
+};
+
+// O(1) LFUCache of p460v3_LFUCache_buckets.cpp.
+class LFUCache {
+public:
+    LFUCache(int capacity) : _capacity(capacity), _minHits(0) {
+        _cache.reserve(capacity);
+    }
+
+    int get(int key) {
+        unordered_map<int, list<Entry>::iterator>::iterator mIt = _cache.find(key);
+        if (mIt == _cache.end()) {
+            return -1;
+        }
+        _touch(mIt->second);
+        return mIt->second->value;
+    }
+
+    void put(int key, int value) {
+        if (_capacity <= 0) {
+            return;
+        }
+        unordered_map<int, list<Entry>::iterator>::iterator mIt = _cache.find(key);
+        if (mIt != _cache.end()) {
+            mIt->second->value = value;
+            _touch(mIt->second);
+            return;
+        }
+        if (_cache.size() == _capacity) {
+            list<Entry>& bucket = _buckets[_minHits];
+            _cache.erase(bucket.front().key);
+            bucket.pop_front();
+            if (bucket.empty()) {
+                _buckets.erase(_minHits);
+            }
+        }
+        list<Entry>& bucket = _buckets[1];
+        bucket.push_back(Entry{key, value, 1});
+        _cache[key] = prev(bucket.end());
+        _minHits = 1;
+    }
+
+private:
+    struct Entry {
+        int key;
+        int value;
+        int numHits;
+    };
+
+    void _touch(list<Entry>::iterator it) {
+        int hits = it->numHits;
+        list<Entry>& from = _buckets[hits];
+        list<Entry>& to = _buckets[hits + 1];
+        to.splice(to.end(), from, it);
+        it->numHits++;
+        if (from.empty()) {
+            _buckets.erase(hits);
+            if (_minHits == hits) {
+                _minHits = hits + 1;
+            }
+        }
+    }
+
+    int _capacity;
+    int _minHits;
+    unordered_map<int, list<Entry>> _buckets;
+    unordered_map<int, list<Entry>::iterator> _cache;
+};
+
+struct XorShift {
+    uint64_t s;
+    XorShift(uint64_t seed) : s(seed) {}
+    uint64_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+class ZipfGenerator {
+public:
+    ZipfGenerator(int n, double theta) : _cdf(n) {
+        double sum = 0.0;
+        for (int k = 0; k < n; ++k) {
+            sum += 1.0 / pow(k + 1, theta);
+            _cdf[k] = sum;
+        }
+        for (double& c : _cdf) {
+            c /= sum;
+        }
+    }
+
+    int next(XorShift& rng) {
+        double u = (rng.next() >> 11) * (1.0 / 9007199254740992.0);
+        return lower_bound(_cdf.begin(), _cdf.end(), u) - _cdf.begin();
+    }
+
+private:
+    vector<double> _cdf;
+};
+
+vector<int> zipfTrace(int numKeys, int length, uint64_t seed) {
+    ZipfGenerator zipf(numKeys, 0.99);
+    XorShift rng(seed);
+    vector<int> trace(length);
+    for (int& key : trace) {
+        key = zipf.next(rng);
+    }
+    return trace;
+}
+
+// Zipfian accesses interrupted by one-off sequential scans over cold keys, each
+// as long as scanLength.
+vector<int> zipfWithScansTrace(int numKeys, int length, int scanLength) {
+    vector<int> trace = zipfTrace(numKeys, length, 7);
+    int scanKey = numKeys;
+    for (int i = 0; i + scanLength <= length; i += 5 * scanLength) {
+        for (int j = i; j < i + scanLength; ++j) {
+            trace[j] = scanKey++;
+        }
+    }
+    return trace;
+}
+
+// A loop over slightly more keys than fit in the cache: the worst case of LRU.
+vector<int> loopTrace(int numKeys, int length) {
+    vector<int> trace(length);
+    for (int i = 0; i < length; ++i) {
+        trace[i] = i % numKeys;
+    }
+    return trace;
+}
+
+// Zipfian popularity whose ranking moves to a new set of keys every phaseLength
+// requests, as in p460v4_LFUCache_tinylfu.cpp.
+vector<int> shiftingZipfTrace(int numKeys, int length, int phaseLength, uint64_t seed) {
+    ZipfGenerator zipf(numKeys, 0.9);
+    XorShift rng(seed);
+    vector<int> trace(length);
+    for (int i = 0; i < length; ++i) {
+        int phase = i / phaseLength;
+        int rank = zipf.next(rng);
+        trace[i] = static_cast<int>((static_cast<uint64_t>(rank) * 2654435761u + phase * 7919u) % (4u * numKeys));
+    }
+    return trace;
+}
+
+// Alternates batch jobs (a loop over a large key range, repeated) with
+// interactive phases (a Zipfian hot set that moves every phase).
+vector<int> batchAndInteractiveTrace(int numKeys, int length, int phaseLength) {
+    vector<int> hot = shiftingZipfTrace(numKeys, length, 2 * phaseLength, 11);
+    vector<int> trace(length);
+    int batchKey = 0;
+    for (int i = 0; i < length; ++i) {
+        if ((i / phaseLength) % 2 == 0) {
+            trace[i] = hot[i];
+        } else {
+            trace[i] = 4 * numKeys + (batchKey++ % (numKeys / 2));
+        }
+    }
+    return trace;
+}
+
+// Read-through replay: get, and put on a miss. Prints the hit ratio in % and
+// ns/op.
+template <typename Cache>
+void replay(vector<int> const & trace, int capacity) {
+    Cache cache(capacity);
+    long long hits = 0;
+    auto start = chrono::steady_clock::now();
+    for (int key : trace) {
+        if (cache.get(key) != -1) {
+            ++hits;
+        } else {
+            cache.put(key, key);
+        }
+    }
+    auto end = chrono::steady_clock::now();
+    cout << "\t" << 100.0 * hits / trace.size() << "% ("
+         << chrono::duration<double, nano>(end - start).count() / trace.size() << " ns)";
+}
+
+int main() {
+    int capacity = 2;
+    ARCCache* obj = new ARCCache(capacity);
+    cout << "obj->put(1, 1);" << endl;
+    obj->put(1, 1);
+    cout << "obj->put(2, 2);" << endl;
+    obj->put(2, 2);
+    int param_1 = obj->get(1);
+    cout << "int param_1 = obj->get(1); " << param_1 << endl;
+    cout << "obj->put(3, 3);" << endl;
+    obj->put(3, 3);
+    int param_2 = obj->get(2);
+    cout << "int param_2 = obj->get(2); " << param_2 << endl;
+    int param_3 = obj->get(3);
+    cout << "int param_3 = obj->get(3); " << param_3 << endl;
+    // 1 was hit, so it is in T2: the new key 3 replaced 2, the LRU of T1.
+    assert(param_1 == 1 && param_2 == -1 && param_3 == 3);
+    assert(obj->get(1) == 1);
+    delete obj;
+    cout << endl;
+
+    // A scan does not flush the frequently used entries.
+    ARCCache scan(100);
+    for (int round = 0; round < 2; ++round) {
+        for (int k = 0; k < 50; ++k) {
+            scan.put(k, k);
+            scan.get(k);
+        }
+    }
+    for (int k = 1000; k < 2000; ++k) {
+        scan.put(k, k);
+    }
+    for (int k = 0; k < 50; ++k) {
+        assert(scan.get(k) == k);
+    }
+    // Ghost hits on B1 grow the target size of T1.
+    for (int k = 1900; k >= 1800; --k) {
+        scan.put(k, k);
+    }
+    assert(scan.target() > 0);
+    cout << "Scan resistance and adaptation checks passed (p = " << scan.target() << ")." << endl << endl;
+
+    int numKeys = 100000;
+    int length = 4000000;
+    int cacheCapacity = 10000;
+    vector<pair<string, vector<int>>> traces;
+    traces.emplace_back("Zipf 0.99", zipfTrace(numKeys, length, 1));
+    traces.emplace_back("Zipf+scans", zipfWithScansTrace(numKeys, length, 4 * cacheCapacity));
+    traces.emplace_back("Loop 11K", loopTrace(cacheCapacity + cacheCapacity / 10, length));
+    traces.emplace_back("Shifting", shiftingZipfTrace(numKeys, length, 200000, 3));
+    traces.emplace_back("Batch/inter.", batchAndInteractiveTrace(numKeys, length, 200000));
+
+    cout << "Hit ratio (read-through, capacity " << cacheCapacity << "):" << endl;
+    cout << "trace\t\tLRU\t\t\tLFU\t\t\tARC" << endl;
+    for (pair<string, vector<int>> const & t : traces) {
+        cout << t.first << (t.first.size() < 8 ? "\t" : "");
+        replay<LRUCache>(t.second, cacheCapacity);
+        replay<LFUCache>(t.second, cacheCapacity);
+        replay<ARCCache>(t.second, cacheCapacity);
+        cout << endl;
+    }
+    return 0;
+}
@@ -24,6 +24,12 @@ def printPut(key, val):
     print()
 
 
+def _parse_args(s):
+    # '2' -> 2, '10,100' -> (10, 100): keys and values may have several digits.
+    values = [int(v) for v in s.split(',')]
+    return values[0] if len(values) == 1 else tuple(values)
+
+
 def main():
     op_string = input('Type the two input rows:\n')
     arg_string = input()
@@ -33,7 +39,7 @@ def main():
     
     ops = map(lambda s: s[1: -1], op_string.split(','))
     args = _args_pattern.findall(arg_string)
-    args = map(lambda s: int(s) if len(s) == 1 else (int(s[0]), int(s[2])), args)
+    args = map(_parse_args, args)
     
     pairs = list(zip(ops, args))
     printCtor(pairs[0][1])
@@ -0,0 +1,546 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <list>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Miss-ratio curves of LRU and LFU for a key trace, to choose a capacity
+// without replaying the trace once per candidate size:
+//
+//   mrc_simulator [--rate=R] [--max-capacity=N] [--points=P] <trace>
+//   mrc_simulator --self-test
+//
+// <trace> holds one integer key per access (whitespace separated), replayed as
+// a read-through cache: every access is a get, followed by a put on a miss.
+// Writes "capacity,lru_hit_ratio,lfu_hit_ratio" as CSV on stdout, at P evenly
+// spaced capacities up to N (default: the number of distinct keys), and a
+// summary on stderr.
+//
+// * LRU is exact and takes a single pass: the LRU stack distance of every
+//   access is computed with a Fenwick tree, and a cache of capacity C hits
+//   exactly the accesses whose distance is at most C.
+// * LFU is not a stack algorithm, so it has no single-pass curve. It is
+//   approximated with miniature simulations: the sampled accesses are kept in
+//   memory, and one O(1) LFUCache of capacity C * R is replayed over them per
+//   point of the curve.
+// * --rate=R (SHARDS, Waldspurger et al., FAST 2015) only keeps the keys whose
+//   hash falls below R, and scales distances and capacities by 1 / R. With
+//   R = 0.01 a 1B-access trace keeps ~10M accesses; on the Zipf trace of the
+//   self-test both curves stay within one point of hit ratio of the exact ones.
+//   The default is R = 1 (exact LRU, exact LFU at each point; the whole trace is
+//   kept in memory for LFU).
+
+// Fenwick tree over time: position t is 1 if the access at time t is the last
+// one to its key so far. The number of distinct keys accessed after time t is
+// then a range sum, which is the LRU stack distance of the next access to the
+// key last seen at t.
+//
+// Time is renumbered (compacted) when it reaches the end of the tree, keeping
+// only the last access of each key, so the tree is O(distinct keys) and not
+// O(trace length).
+class StackDistance {
+public:
+    StackDistance() : _now(0), _coldMisses(0), _accesses(0) {
+        _tree.assign(1024 + 1, 0);
+    }
+
+    void access(int key) {
+        if (_now == _size()) {
+            _compact();
+        }
+
+        ++_accesses;
+        unordered_map<int, long long>::iterator it = _last.find(key);
+        if (it == _last.end()) {
+            ++_coldMisses;
+            _last.emplace(key, _now);
+        } else {
+            long long last = it->second;
+            // Distinct keys accessed since the last access to this key, plus itself.
+            long long distance = _prefix(_now - 1) - _prefix(last) + 1;
+            if (distance >= static_cast<long long>(_histogram.size())) {
+                _histogram.resize(max<size_t>(distance + 1, 2 * _histogram.size()), 0);
+            }
+            ++_histogram[distance];
+            _add(last, -1);
+            it->second = _now;
+        }
+        _add(_now, 1);
+        ++_now;
+    }
+
+    // Hit ratio of an LRU cache holding capacity keys, for all the capacities
+    // up to maxCapacity: out[c] for c in [0, maxCapacity].
+    //
+    // expectedAccesses corrects a sampled stream (SHARDS_adj): a few hot keys
+    // that happen to be kept, or dropped, skew the number of sampled accesses.
+    // The difference with the expected number is almost all short-distance
+    // reuse of those keys, so it is credited to (or taken from) distance 1.
+    vector<double> hitRatios(long long maxCapacity, double expectedAccesses) const {
+        vector<double> out(maxCapacity + 1, 0.0);
+        if (expectedAccesses <= 0.0) {
+            return out;
+        }
+        double hits = expectedAccesses - _accesses;
+        for (long long c = 1; c <= maxCapacity; ++c) {
+            if (c < static_cast<long long>(_histogram.size())) {
+                hits += _histogram[c];
+            }
+            out[c] = min(1.0, max(0.0, hits / expectedAccesses));
+        }
+        return out;
+    }
+
+    long long accesses() const {
+        return _accesses;
+    }
+
+    long long distinctKeys() const {
+        return _last.size();
+    }
+
+private:
+    long long _size() const {
+        return _tree.size() - 1;
+    }
+
+    void _add(long long t, int delta) {
+        for (long long i = t + 1; i < static_cast<long long>(_tree.size()); i += i & -i) {
+            _tree[i] += delta;
+        }
+    }
+
+    // Sum of the positions [0, t].
+    long long _prefix(long long t) const {
+        long long sum = 0;
+        for (long long i = t + 1; i > 0; i -= i & -i) {
+            sum += _tree[i];
+        }
+        return sum;
+    }
+
+    // Renumbers the last accesses 0..D-1 in time order, and rebuilds the tree
+    // with room for as many accesses again. O(D log D) every ~D accesses.
+    void _compact() {
+        vector<pair<long long, int>> byTime;
+        byTime.reserve(_last.size());
+        for (pair<int const, long long> const & p : _last) {
+            byTime.emplace_back(p.second, p.first);
+        }
+        sort(byTime.begin(), byTime.end());
+
+        long long size = max<long long>(1024, 2 * byTime.size());
+        _tree.assign(size + 1, 0);
+        for (long long t = 0; t < static_cast<long long>(byTime.size()); ++t) {
+            _last[byTime[t].second] = t;
+            _tree[t + 1] = 1;
+        }
+        // Linear-time Fenwick construction from the raw values.
+        for (long long i = 1; i <= size; ++i) {
+            long long parent = i + (i & -i);
+            if (parent <= size) {
+                _tree[parent] += _tree[i];
+            }
+        }
+        _now = byTime.size();
+    }
+
+    vector<int> _tree;
+    long long _now;
+    unordered_map<int, long long> _last;
+
+    // _histogram[d]: number of accesses with stack distance d.
+    vector<long long> _histogram;
+    long long _coldMisses;
+    long long _accesses;
+};
+
+// SHARDS spatial sampling: a key is kept if its hash falls below rate. All the
+// accesses to a kept key are kept, so reuse distances survive the sampling.
+class Sampler {
+public:
+    Sampler(double rate) : _threshold(static_cast<uint64_t>(rate * MODULUS)) {}
+
+    bool keep(int key) const {
+        // splitmix64: without the increment, key 0 would hash to 0 and always be
+        // kept.
+        uint64_t h = static_cast<uint64_t>(static_cast<uint32_t>(key)) + 0x9E3779B97F4A7C15ull;
+        h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ull;
+        h = (h ^ (h >> 27)) * 0x94D049BB133111EBull;
+        h ^= h >> 31;
+        return (h & (MODULUS - 1)) < _threshold;
+    }
+
+private:
+    static const uint64_t MODULUS = 1ull << 24;
+    uint64_t _threshold;
+};
+
+// O(1) LFUCache of p460v3_LFUCache_buckets.cpp.
+class LFUCache {
+public:
+    LFUCache(int capacity) : _capacity(capacity), _minHits(0) {
+        _cache.reserve(capacity);
+    }
+
+    int get(int key) {
+        unordered_map<int, list<Entry>::iterator>::iterator mIt = _cache.find(key);
+        if (mIt == _cache.end()) {
+            return -1;
+        }
+        _touch(mIt->second);
+        return mIt->second->value;
+    }
+
+    void put(int key, int value) {
+        if (_capacity <= 0) {
+            return;
+        }
+        unordered_map<int, list<Entry>::iterator>::iterator mIt = _cache.find(key);
+        if (mIt != _cache.end()) {
+            mIt->second->value = value;
+            _touch(mIt->second);
+            return;
+        }
+        if (_cache.size() == _capacity) {
+            list<Entry>& bucket = _buckets[_minHits];
+            _cache.erase(bucket.front().key);
+            bucket.pop_front();
+            if (bucket.empty()) {
+                _buckets.erase(_minHits);
+            }
+        }
+        list<Entry>& bucket = _buckets[1];
+        bucket.push_back(Entry{key, value, 1});
+        _cache[key] = prev(bucket.end());
+        _minHits = 1;
+    }
+
+private:
+    struct Entry {
+        int key;
+        int value;
+        int numHits;
+    };
+
+    void _touch(list<Entry>::iterator it) {
+        int hits = it->numHits;
+        list<Entry>& from = _buckets[hits];
+        list<Entry>& to = _buckets[hits + 1];
+        to.splice(to.end(), from, it);
+        it->numHits++;
+        if (from.empty()) {
+            _buckets.erase(hits);
+            if (_minHits == hits) {
+                _minHits = hits + 1;
+            }
+        }
+    }
+
+    int _capacity;
+    int _minHits;
+    unordered_map<int, list<Entry>> _buckets;
+    unordered_map<int, list<Entry>::iterator> _cache;
+};
+
+// O(1) LRUCache of p146v2_lru_cache.cpp, only used by the self-test.
+class LRUCache {
+public:
+    LRUCache(int capacity) : _capacity(capacity) {
+        _m.reserve(capacity);
+    }
+
+    int get(int key) {
+        unordered_map<int, list<pair<int, int>>::iterator>::iterator it = _m.find(key);
+        if (it == _m.end()) {
+            return -1;
+        }
+        _q.splice(_q.end(), _q, it->second);
+        return it->second->second;
+    }
+
+    void put(int key, int value) {
+        if (_capacity <= 0) {
+            return;
+        }
+        unordered_map<int, list<pair<int, int>>::iterator>::iterator it = _m.find(key);
+        if (it != _m.end()) {
+            it->second->second = value;
+            _q.splice(_q.end(), _q, it->second);
+            return;
+        }
+        if (_m.size() == _capacity) {
+            list<pair<int, int>>::iterator lru = _q.begin();
+            _m.erase(lru->first);
+            lru->first = key;
+            lru->second = value;
+            _q.splice(_q.end(), _q, lru);
+            _m[key] = lru;
+            return;
+        }
+        _q.emplace_back(key, value);
+        _m[key] = prev(_q.end());
+    }
+
+private:
+    int _capacity;
+    list<pair<int, int>> _q;
+    unordered_map<int, list<pair<int, int>>::iterator> _m;
+};
+
+// Read-through replay: get, and put on a miss. Returns the hit ratio.
+template <typename Cache>
+double hitRatio(vector<int> const & trace, int capacity) {
+    Cache cache(capacity);
+    long long hits = 0;
+    for (int key : trace) {
+        if (cache.get(key) != -1) {
+            ++hits;
+        } else {
+            cache.put(key, key);
+        }
+    }
+    return trace.empty() ? 0.0 : static_cast<double>(hits) / trace.size();
+}
+
+// Streams the integer keys of a text file through a large buffer: much faster
+// than ifstream >> int on traces of billions of keys.
+class KeyReader {
+public:
+    KeyReader(string const & path) : _pos(0), _len(0), _buffer(1 << 20) {
+        _file = fopen(path.c_str(), "rb");
+        if (_file == nullptr) {
+            throw runtime_error("Cannot open " + path);
+        }
+    }
+
+    ~KeyReader() {
+        fclose(_file);
+    }
+
+    bool next(int& key) {
+        int c = _get();
+        while (c != EOF && c != '-' && (c < '0' || c > '9')) {
+            if (c != ' ' && c != '\n' && c != '\r' && c != '\t') {
+                throw runtime_error(string("Unexpected character '") + static_cast<char>(c) + "' in the trace");
+            }
+            c = _get();
+        }
+        if (c == EOF) {
+            return false;
+        }
+        bool negative = c == '-';
+        if (negative) {
+            c = _get();
+        }
+        long long value = 0;
+        for (; c >= '0' && c <= '9'; c = _get()) {
+            value = value * 10 + (c - '0');
+        }
+        key = static_cast<int>(negative ? -value : value);
+        return true;
+    }
+
+private:
+    int _get() {
+        if (_pos == _len) {
+            _len = fread(_buffer.data(), 1, _buffer.size(), _file);
+            _pos = 0;
+            if (_len == 0) {
+                return EOF;
+            }
+        }
+        return static_cast<unsigned char>(_buffer[_pos++]);
+    }
+
+    FILE* _file;
+    size_t _pos;
+    size_t _len;
+    vector<char> _buffer;
+};
+
+struct Curve {
+    vector<long long> capacities;
+    vector<double> lru;
+    vector<double> lfu;
+    long long accesses = 0;
+    long long sampledAccesses = 0;
+    long long distinctKeys = 0;
+};
+
+// Runs the single pass over the keys yielded by next(key), then the LFU
+// miniature simulations over the sample.
+template <typename Source>
+Curve computeCurve(Source& next, double rate, long long maxCapacity, int points) {
+    Sampler sampler(rate);
+    StackDistance lru;
+    vector<int> sample;
+    Curve curve;
+    int key;
+    while (next(key)) {
+        ++curve.accesses;
+        if (rate < 1.0 && !sampler.keep(key)) {
+            continue;
+        }
+        lru.access(key);
+        sample.push_back(key);
+    }
+    curve.sampledAccesses = lru.accesses();
+    curve.distinctKeys = llround(lru.distinctKeys() / rate);
+    if (maxCapacity <= 0) {
+        maxCapacity = max(curve.distinctKeys, 1LL);
+    }
+
+    long long maxScaled = llround(maxCapacity * rate);
+    double expected = rate < 1.0 ? curve.accesses * rate : curve.sampledAccesses;
+    vector<double> lruRatios = lru.hitRatios(maxScaled, expected);
+    for (int i = 1; i <= points; ++i) {
+        long long capacity = maxCapacity * i / points;
+        long long scaled = llround(capacity * rate);
+        curve.capacities.push_back(capacity);
+        curve.lru.push_back(lruRatios[min(scaled, maxScaled)]);
+
+        // Same SHARDS_adj correction as for LRU: the extra (or missing) sampled
+        // accesses count as hits.
+        double hits = hitRatio<LFUCache>(sample, static_cast<int>(scaled)) * sample.size();
+        double adjusted = expected <= 0.0 ? 0.0 : (hits + expected - sample.size()) / expected;
+        curve.lfu.push_back(min(1.0, max(0.0, adjusted)));
+    }
+    return curve;
+}
+
+struct XorShift {
+    uint64_t s;
+    XorShift(uint64_t seed) : s(seed) {}
+    uint64_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+vector<int> zipfTrace(int numKeys, double theta, int length, uint64_t seed) {
+    vector<double> cdf(numKeys);
+    double sum = 0.0;
+    for (int k = 0; k < numKeys; ++k) {
+        sum += 1.0 / pow(k + 1, theta);
+        cdf[k] = sum;
+    }
+    XorShift rng(seed);
+    vector<int> trace(length);
+    for (int& key : trace) {
+        double u = (rng.next() >> 11) * (1.0 / 9007199254740992.0) * sum;
+        key = lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+    }
+    return trace;
+}
+
+Curve curveOf(vector<int> const & trace, double rate, long long maxCapacity, int points) {
+    size_t i = 0;
+    auto next = [&](int& key) {
+        if (i == trace.size()) {
+            return false;
+        }
+        key = trace[i++];
+        return true;
+    };
+    return computeCurve(next, rate, maxCapacity, points);
+}
+
+// Checks the exact curve against one replay per capacity, and measures the error
+// of sampling on a synthetic trace.
+int selfTest() {
+    vector<int> small = zipfTrace(3000, 0.9, 200000, 1);
+    Curve exact = curveOf(small, 1.0, 2000, 10);
+    for (size_t i = 0; i < exact.capacities.size(); ++i) {
+        int capacity = exact.capacities[i];
+        if (exact.lru[i] != hitRatio<LRUCache>(small, capacity)
+            || exact.lfu[i] != hitRatio<LFUCache>(small, capacity)) {
+            cerr << "Mismatch at capacity " << capacity << endl;
+            return 1;
+        }
+    }
+    cerr << "Exact curves match one replay per capacity." << endl;
+
+    int numKeys = 1000000;
+    vector<int> trace = zipfTrace(numKeys, 0.99, 4000000, 2);
+    auto start = chrono::steady_clock::now();
+    Curve full = curveOf(trace, 1.0, 500000, 10);
+    auto mid = chrono::steady_clock::now();
+    Curve sampled = curveOf(trace, 0.01, 500000, 10);
+    auto end = chrono::steady_clock::now();
+
+    double lruError = 0.0;
+    double lfuError = 0.0;
+    cout << "capacity,lru_hit_ratio,lru_sampled,lfu_hit_ratio,lfu_sampled" << endl;
+    for (size_t i = 0; i < full.capacities.size(); ++i) {
+        cout << full.capacities[i] << "," << full.lru[i] << "," << sampled.lru[i] << ","
+             << full.lfu[i] << "," << sampled.lfu[i] << endl;
+        lruError = max(lruError, fabs(full.lru[i] - sampled.lru[i]));
+        lfuError = max(lfuError, fabs(full.lfu[i] - sampled.lfu[i]));
+    }
+    cerr << trace.size() << " accesses, Zipf 0.99 over " << numKeys << " keys:" << endl;
+    cerr << "  exact (rate 1, 10 LFU replays): " << chrono::duration<double>(mid - start).count() << " s" << endl;
+    cerr << "  SHARDS rate 0.01: " << chrono::duration<double>(end - mid).count() << " s, "
+         << sampled.sampledAccesses << " sampled accesses, max error LRU "
+         << 100 * lruError << " points, LFU " << 100 * lfuError << " points" << endl;
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    double rate = 1.0;
+    long long maxCapacity = 0;
+    int points = 20;
+    vector<string> paths;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--self-test") {
+            return selfTest();
+        } else if (arg.compare(0, 7, "--rate=") == 0) {
+            rate = stod(arg.substr(7));
+        } else if (arg.compare(0, 15, "--max-capacity=") == 0) {
+            maxCapacity = stoll(arg.substr(15));
+        } else if (arg.compare(0, 9, "--points=") == 0) {
+            points = stoi(arg.substr(9));
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.size() != 1 || rate <= 0.0 || rate > 1.0 || points <= 0) {
+        cerr << "Usage: " << argv[0] << " [--rate=R] [--max-capacity=N] [--points=P] <trace>" << endl;
+        cerr << "       " << argv[0] << " --self-test" << endl;
+        return 2;
+    }
+
+    try {
+        KeyReader reader(paths[0]);
+        auto next = [&reader](int& key) {
+            return reader.next(key);
+        };
+        auto start = chrono::steady_clock::now();
+        Curve curve = computeCurve(next, rate, maxCapacity, points);
+        auto end = chrono::steady_clock::now();
+
+        cout << "capacity,lru_hit_ratio,lfu_hit_ratio" << endl;
+        for (size_t i = 0; i < curve.capacities.size(); ++i) {
+            cout << curve.capacities[i] << "," << curve.lru[i] << "," << curve.lfu[i] << endl;
+        }
+        cerr << curve.accesses << " accesses (" << curve.sampledAccesses << " sampled), ~"
+             << curve.distinctKeys << " distinct keys, "
+             << chrono::duration<double>(end - start).count() << " s" << endl;
+        return 0;
+    } catch (exception const & e) {
+        cerr << "Error: " << e.what() << endl;
+        return 2;
+    }
+}
@@ -0,0 +1,435 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Point-in-time copy of the counters of a cache.
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t inserts = 0;
+    uint64_t updates = 0;
+    uint64_t evictions = 0;
+    uint64_t size = 0;
+    uint64_t peakSize = 0;
+
+    double hitRatio() const {
+        uint64_t lookups = hits + misses;
+        return lookups == 0 ? 0.0 : static_cast<double>(hits) / lookups;
+    }
+
+    string toString() const {
+        ostringstream out;
+        out << "hits=" << hits << " misses=" << misses << " hitRatio=" << hitRatio()
+            << " inserts=" << inserts << " updates=" << updates << " evictions=" << evictions
+            << " size=" << size << " peakSize=" << peakSize;
+        return out.str();
+    }
+
+    string toJson() const {
+        ostringstream out;
+        out << "{\"hits\":" << hits << ",\"misses\":" << misses << ",\"hitRatio\":" << hitRatio()
+            << ",\"inserts\":" << inserts << ",\"updates\":" << updates
+            << ",\"evictions\":" << evictions << ",\"size\":" << size
+            << ",\"peakSize\":" << peakSize << "}";
+        return out.str();
+    }
+};
+
+// Live counters of a cache. They are only written by the thread that owns the
+// cache, so a plain load + store is enough (no read-modify-write): the atomics
+// are only there so that snapshot can read them from another thread at any time.
+// The slot has its own cache lines, so that a monitoring thread reading it does
+// not keep stealing the lines of the entries.
+struct alignas(64) StatsSlot {
+    atomic<uint64_t> hits{0};
+    atomic<uint64_t> misses{0};
+    atomic<uint64_t> inserts{0};
+    atomic<uint64_t> updates{0};
+    atomic<uint64_t> evictions{0};
+    atomic<uint64_t> size{0};
+    atomic<uint64_t> peakSize{0};
+
+    static void inc(atomic<uint64_t>& counter) {
+        counter.store(counter.load(memory_order_relaxed) + 1, memory_order_relaxed);
+    }
+
+    void addTo(CacheStats& s) const {
+        s.hits += hits.load(memory_order_relaxed);
+        s.misses += misses.load(memory_order_relaxed);
+        s.inserts += inserts.load(memory_order_relaxed);
+        s.updates += updates.load(memory_order_relaxed);
+        s.evictions += evictions.load(memory_order_relaxed);
+        s.size += size.load(memory_order_relaxed);
+        s.peakSize += peakSize.load(memory_order_relaxed);
+    }
+};
+
+struct Entry {
+    int key;
+    int value;
+    int numHits;
+    int lastHit;
+
+    bool operator<(Entry const & rhs) const {
+        // The "lower" entry is the one with more priority to be evicted:
+        // * least frequently used;
+        // * least recently used.
+        if (numHits < rhs.numHits) {
+            return true;
+        } else if (numHits > rhs.numHits) {
+            return false;
+        } else {
+            return lastHit < rhs.lastHit;
+        }
+    }
+};
+
+typedef list<Entry>::iterator entryIt;
+
+// LFUCache of p460_LFUCache.cpp, with hit/miss/insert/update/eviction/size
+// counters. STATS = false compiles the counters out, to measure their cost.
+template <bool STATS = true>
+class LFUCache {
+public:
+    LFUCache(int capacity) : _capacity(capacity), _count(0) {}
+    int get(int key);
+    void put(int key, int value);
+
+    CacheStats snapshot() const {
+        CacheStats s;
+        _stats.addTo(s);
+        return s;
+    }
+
+private:
+    void _update(entryIt& it);
+    
+    int _capacity;
+    int _count;
+
+    // Stores all the elements in the cache in priority order: the front is always
+    // the next element to be evicted.
+    list<Entry> _l;
+
+    // Maps a key to a pointer in the list.
+    unordered_map<int, entryIt> _cache;
+
+    StatsSlot _stats;
+};
+
+// Update the position of the element pointed by the provided iterator
+// in the list.
+template <bool STATS>
+void LFUCache<STATS>::_update(entryIt& it) {
+    // When we erase we get an iterator to the next element, but we invalidate
+    // the erased iterator: make a copy of the entry first.
+    Entry entry(*it);
+    entryIt nextIt = _l.erase(it);
+    
+    // Where should we insert this element back?
+    for (; nextIt != _l.end() && *nextIt < entry; ++nextIt) {}
+    
+    it = _l.insert(nextIt, entry);
+}
+
+template <bool STATS>
+int LFUCache<STATS>::get(int key) {
+    ++_count;
+    unordered_map<int, entryIt>::iterator mIt = _cache.find(key);
+    if (mIt == _cache.end()) {
+       // Cache miss.
+        if (STATS) {
+            StatsSlot::inc(_stats.misses);
+        }
+        return -1;
+    }
+
+    if (STATS) {
+        StatsSlot::inc(_stats.hits);
+    }
+
+    // Element found: retrieve it, update it and return it.
+    entryIt& lIt = mIt->second;
+    lIt->numHits++;
+    lIt->lastHit = _count;
+    _update(lIt);
+    return lIt->value;
+}
+
+template <bool STATS>
+void LFUCache<STATS>::put(int key, int value) {
+    ++_count;
+    if (_capacity == 0) {
+        return;
+    }
+
+    unordered_map<int, entryIt>::iterator mIt = _cache.find(key);
+    if (mIt != _cache.end()) {
+        // Update existing value.
+        entryIt& lIt = mIt->second;
+        lIt->value = value;
+        lIt->numHits++;
+        lIt->lastHit = _count;
+        _update(lIt);
+        if (STATS) {
+            StatsSlot::inc(_stats.updates);
+        }
+    } else {
+        // Insert a new value.
+        if (_cache.size() == _capacity && _capacity > 0) {
+            // We are at max capacity: remove the LFU element before inserting a new value.
+            int lfuKey = _l.front().key;
+            _cache.erase(lfuKey);
+            _l.pop_front();
+            if (STATS) {
+                StatsSlot::inc(_stats.evictions);
+            }
+        }
+
+        // Insert the new value in the list...
+        Entry entry;
+        entry.key = key;
+        entry.value = value;
+        entry.numHits = 1;
+        entry.lastHit = _count;
+        _l.push_front(entry);
+        entryIt lIt = _l.begin();
+        _update(lIt);
+
+        // ...and in the cache.
+        _cache.insert(pair<int, entryIt>(key, lIt));
+
+        if (STATS) {
+            StatsSlot::inc(_stats.inserts);
+            uint64_t size = _cache.size();
+            _stats.size.store(size, memory_order_relaxed);
+            if (size > _stats.peakSize.load(memory_order_relaxed)) {
+                _stats.peakSize.store(size, memory_order_relaxed);
+            }
+        }
+    }
+}
+
+// O(1) LFUCache of p460v3_LFUCache_buckets.cpp (one LRU-ordered bucket per hit
+// count), with the same counters. The benchmark measures their cost on it: on
+// the sorted list above, the O(capacity) walk of _update dwarfs them.
+struct BucketEntry {
+    int key;
+    int value;
+    int numHits;
+};
+
+template <bool STATS = true>
+class BucketLFUCache {
+public:
+    BucketLFUCache(int capacity) : _capacity(capacity), _minHits(0) {
+        _cache.reserve(capacity);
+    }
+
+    int get(int key) {
+        typename unordered_map<int, list<BucketEntry>::iterator>::iterator mIt = _cache.find(key);
+        if (mIt == _cache.end()) {
+            if (STATS) {
+                StatsSlot::inc(_stats.misses);
+            }
+            return -1;
+        }
+        if (STATS) {
+            StatsSlot::inc(_stats.hits);
+        }
+        _touch(mIt->second);
+        return mIt->second->value;
+    }
+
+    void put(int key, int value) {
+        if (_capacity <= 0) {
+            return;
+        }
+
+        typename unordered_map<int, list<BucketEntry>::iterator>::iterator mIt = _cache.find(key);
+        if (mIt != _cache.end()) {
+            mIt->second->value = value;
+            _touch(mIt->second);
+            if (STATS) {
+                StatsSlot::inc(_stats.updates);
+            }
+            return;
+        }
+
+        if (_cache.size() == _capacity) {
+            list<BucketEntry>& bucket = _buckets[_minHits];
+            _cache.erase(bucket.front().key);
+            bucket.pop_front();
+            if (bucket.empty()) {
+                _buckets.erase(_minHits);
+            }
+            if (STATS) {
+                StatsSlot::inc(_stats.evictions);
+            }
+        }
+
+        list<BucketEntry>& bucket = _buckets[1];
+        bucket.push_back(BucketEntry{key, value, 1});
+        _cache[key] = prev(bucket.end());
+        _minHits = 1;
+
+        if (STATS) {
+            StatsSlot::inc(_stats.inserts);
+            uint64_t size = _cache.size();
+            _stats.size.store(size, memory_order_relaxed);
+            if (size > _stats.peakSize.load(memory_order_relaxed)) {
+                _stats.peakSize.store(size, memory_order_relaxed);
+            }
+        }
+    }
+
+    CacheStats snapshot() const {
+        CacheStats s;
+        _stats.addTo(s);
+        return s;
+    }
+
+private:
+    void _touch(list<BucketEntry>::iterator it) {
+        int hits = it->numHits;
+        list<BucketEntry>& from = _buckets[hits];
+        list<BucketEntry>& to = _buckets[hits + 1];
+        to.splice(to.end(), from, it);
+        it->numHits++;
+        if (from.empty()) {
+            _buckets.erase(hits);
+            if (_minHits == hits) {
+                _minHits = hits + 1;
+            }
+        }
+    }
+
+    int _capacity;
+    int _minHits;
+    unordered_map<int, list<BucketEntry>> _buckets;
+    unordered_map<int, list<BucketEntry>::iterator> _cache;
+
+    StatsSlot _stats;
+};
+
+struct XorShift {
+    uint64_t s;
+    XorShift(uint64_t seed) : s(seed) {}
+    uint64_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+// Sum of all the values read, printed at the end so that the compiler cannot
+// drop the benchmark loops.
+static long long checksum = 0;
+
+// Read-through workload (get, and put on a miss) over Zipfian keys.
+// Returns ns per operation.
+template <bool STATS>
+double benchmark(vector<int> const & keys, int capacity, CacheStats* stats) {
+    BucketLFUCache<STATS> cache(capacity);
+    auto start = chrono::steady_clock::now();
+    for (int key : keys) {
+        int value = cache.get(key);
+        if (value == -1) {
+            cache.put(key, key);
+        }
+        checksum += value;
+    }
+    auto end = chrono::steady_clock::now();
+    if (stats != nullptr) {
+        *stats = cache.snapshot();
+    }
+    return chrono::duration<double, nano>(end - start).count() / keys.size();
+}
+
+int main() {
+    int capacity = 2;
+    LFUCache<>* obj = new LFUCache<>(capacity);
+    obj->put(1, 1);
+    obj->put(2, 2);
+    obj->get(1);
+    obj->put(3, 3);
+    obj->get(2);
+    obj->get(3);
+    obj->put(4, 4);
+    obj->put(3, 30);
+    cout << obj->snapshot().toString() << endl;
+    cout << obj->snapshot().toJson() << endl;
+
+    CacheStats s = obj->snapshot();
+    assert(s.hits == 2 && s.misses == 1);
+    assert(s.inserts == 4 && s.updates == 1 && s.evictions == 2);
+    assert(s.size == 2 && s.peakSize == 2);
+    delete obj;
+
+    // The O(1) cache evicts the same entries, and counts the same.
+    LFUCache<> sorted(100);
+    BucketLFUCache<> buckets(100);
+    XorShift check(7);
+    for (int i = 0; i < 200000; ++i) {
+        uint64_t r = check.next();
+        int key = (r >> 8) % 300;
+        if (r & 1) {
+            assert(sorted.get(key) == buckets.get(key));
+        } else {
+            sorted.put(key, i);
+            buckets.put(key, i);
+        }
+    }
+    assert(sorted.snapshot().toJson() == buckets.snapshot().toJson());
+    cout << endl;
+
+    // Overhead of the counters on the hot path, on the O(1) cache.
+    int numKeys = 1000000;
+    vector<double> cdf(numKeys);
+    double sum = 0.0;
+    for (int k = 0; k < numKeys; ++k) {
+        sum += 1.0 / pow(k + 1, 0.99);
+        cdf[k] = sum;
+    }
+    XorShift rng(1);
+    vector<int> keys(5000000);
+    for (int& key : keys) {
+        double u = (rng.next() >> 11) * (1.0 / 9007199254740992.0) * sum;
+        key = lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+    }
+
+    // Alternate the runs and compare the medians, to filter out noise.
+    int numRuns = 11;
+    vector<double> times[2];
+    CacheStats stats;
+    for (int run = 0; run < numRuns; ++run) {
+        times[0].push_back(benchmark<false>(keys, 100000, nullptr));
+        times[1].push_back(benchmark<true>(keys, 100000, &stats));
+    }
+    double median[2];
+    for (int i = 0; i < 2; ++i) {
+        sort(times[i].begin(), times[i].end());
+        median[i] = times[i][numRuns / 2];
+    }
+    cout << "Benchmark (Zipf 0.99 over " << numKeys << " keys, capacity 100000, read-through, median of "
+         << numRuns << " runs):" << endl;
+    cout << "  " << stats.toString() << endl;
+    cout << "  without stats: " << median[0] << " ns/op (min " << times[0][0] << ", max " << times[0].back() << ")" << endl;
+    cout << "  with stats:    " << median[1] << " ns/op (min " << times[1][0] << ", max " << times[1].back()
+         << "), overhead " << 100.0 * (median[1] - median[0]) / median[0] << "%" << endl;
+    cout << "  (checksum " << checksum << ")" << endl;
+    return 0;
+}
@@ -0,0 +1,293 @@
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+struct Entry {
+    int key;
+    int value;
+    int numHits;
+};
+
+typedef list<Entry>::iterator entryIt;
+
+// Same policy as the LFUCache of p460_LFUCache.cpp (evict the least frequently
+// used entry, and among those the least recently used one), but every operation
+// is O(1): instead of one list sorted by (numHits, lastHit), entries are grouped
+// in one bucket per hit count, each bucket in LRU order. A hit moves the entry
+// from the back of its bucket to the back of the next one, and the victim is the
+// front of the lowest non-empty bucket.
+class LFUCache {
+public:
+    LFUCache(int capacity) : _capacity(capacity), _minHits(0) {
+        _cache.reserve(capacity);
+    }
+    int get(int key);
+    void put(int key, int value);
+
+private:
+    void _touch(entryIt& it);
+
+    int _capacity;
+
+    // Lowest hit count of any entry in the cache: its bucket holds the next
+    // element to be evicted.
+    int _minHits;
+
+    // Maps a hit count to the entries with that count, least recently used first.
+    // Empty buckets are removed.
+    unordered_map<int, list<Entry>> _buckets;
+
+    // Maps a key to a pointer in its bucket.
+    unordered_map<int, entryIt> _cache;
+};
+
+// Counts a hit on the entry pointed by the provided iterator: move it to the back
+// of the next bucket.
+void LFUCache::_touch(entryIt& it) {
+    int hits = it->numHits;
+    list<Entry>& from = _buckets[hits];
+    list<Entry>& to = _buckets[hits + 1];
+
+    // Splicing keeps the node (and thus the iterator in _cache) valid.
+    to.splice(to.end(), from, it);
+    it->numHits++;
+
+    if (from.empty()) {
+        _buckets.erase(hits);
+        if (_minHits == hits) {
+            _minHits = hits + 1;
+        }
+    }
+}
+
+int LFUCache::get(int key) {
+    unordered_map<int, entryIt>::iterator mIt = _cache.find(key);
+    if (mIt == _cache.end()) {
+        // Cache miss.
+        return -1;
+    }
+
+    _touch(mIt->second);
+    return mIt->second->value;
+}
+
+void LFUCache::put(int key, int value) {
+    if (_capacity <= 0) {
+        return;
+    }
+
+    unordered_map<int, entryIt>::iterator mIt = _cache.find(key);
+    if (mIt != _cache.end()) {
+        // Update existing value.
+        mIt->second->value = value;
+        _touch(mIt->second);
+        return;
+    }
+
+    if (_cache.size() == _capacity) {
+        // We are at max capacity: remove the LFU element before inserting a new value.
+        list<Entry>& bucket = _buckets[_minHits];
+        _cache.erase(bucket.front().key);
+        bucket.pop_front();
+        if (bucket.empty()) {
+            _buckets.erase(_minHits);
+        }
+    }
+
+    // A new entry has the lowest possible count.
+    list<Entry>& bucket = _buckets[1];
+    bucket.push_back(Entry{key, value, 1});
+    _cache[key] = prev(bucket.end());
+    _minHits = 1;
+}
+
+// LFUCache of p460_LFUCache.cpp, used as the reference.
+struct SortedEntry {
+    int key;
+    int value;
+    int numHits;
+    int lastHit;
+
+    bool operator<(SortedEntry const & rhs) const {
+        if (numHits < rhs.numHits) {
+            return true;
+        } else if (numHits > rhs.numHits) {
+            return false;
+        } else {
+            return lastHit < rhs.lastHit;
+        }
+    }
+};
+
+class SortedListLFUCache {
+public:
+    SortedListLFUCache(int capacity) : _capacity(capacity), _count(0) {}
+
+    int get(int key) {
+        ++_count;
+        unordered_map<int, list<SortedEntry>::iterator>::iterator mIt = _cache.find(key);
+        if (mIt == _cache.end()) {
+            return -1;
+        }
+        list<SortedEntry>::iterator& lIt = mIt->second;
+        lIt->numHits++;
+        lIt->lastHit = _count;
+        _update(lIt);
+        return lIt->value;
+    }
+
+    void put(int key, int value) {
+        ++_count;
+        if (_capacity == 0) {
+            return;
+        }
+        unordered_map<int, list<SortedEntry>::iterator>::iterator mIt = _cache.find(key);
+        if (mIt != _cache.end()) {
+            list<SortedEntry>::iterator& lIt = mIt->second;
+            lIt->value = value;
+            lIt->numHits++;
+            lIt->lastHit = _count;
+            _update(lIt);
+        } else {
+            if (_cache.size() == _capacity) {
+                _cache.erase(_l.front().key);
+                _l.pop_front();
+            }
+            _l.push_front(SortedEntry{key, value, 1, _count});
+            list<SortedEntry>::iterator lIt = _l.begin();
+            _update(lIt);
+            _cache.insert(make_pair(key, lIt));
+        }
+    }
+
+private:
+    void _update(list<SortedEntry>::iterator& it) {
+        SortedEntry entry(*it);
+        list<SortedEntry>::iterator nextIt = _l.erase(it);
+        for (; nextIt != _l.end() && *nextIt < entry; ++nextIt) {}
+        it = _l.insert(nextIt, entry);
+    }
+
+    int _capacity;
+    int _count;
+    list<SortedEntry> _l;
+    unordered_map<int, list<SortedEntry>::iterator> _cache;
+};
+
+struct XorShift {
+    uint64_t s;
+    XorShift(uint64_t seed) : s(seed) {}
+    uint64_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+// Random operations on both implementations: every get must return the same.
+void checkAgainstReference(int capacity, int numKeys, int numOps) {
+    LFUCache cache(capacity);
+    SortedListLFUCache reference(capacity);
+    XorShift rng(capacity * 31 + numKeys);
+    for (int i = 0; i < numOps; ++i) {
+        uint64_t r = rng.next();
+        int key = (r >> 8) % numKeys;
+        if (r & 1) {
+            assert(cache.get(key) == reference.get(key));
+        } else {
+            cache.put(key, i);
+            reference.put(key, i);
+        }
+    }
+}
+
+// Sum of all the values read, printed at the end so that the compiler cannot
+// drop the benchmark loops.
+static long long checksum = 0;
+
+// Fills the cache, then runs a skewed mix of gets and puts: keys below the
+// capacity are hot, and one in eight keys is a cold miss. Returns ns/op.
+template <typename Cache>
+double benchmark(int capacity, int numOps) {
+    Cache cache(capacity);
+    for (int k = 0; k < capacity; ++k) {
+        cache.put(k, k);
+    }
+
+    XorShift rng(capacity);
+    vector<int> keys(numOps);
+    for (int& key : keys) {
+        uint64_t r = rng.next();
+        // Half of the accesses go to 1% of the keys.
+        if (r & 1) {
+            key = (r >> 4) % (capacity / 100 + 1);
+        } else {
+            key = (r >> 4) % (capacity + capacity / 8);
+        }
+    }
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < numOps; ++i) {
+        if (i % 4 == 0) {
+            cache.put(keys[i], i);
+        } else {
+            checksum += cache.get(keys[i]);
+        }
+    }
+    auto end = chrono::steady_clock::now();
+    return chrono::duration<double, nano>(end - start).count() / numOps;
+}
+
+int main() {
+    int capacity = 2;
+    LFUCache* obj = new LFUCache(capacity);
+
+    cout << "obj->put(1, 1);" << endl;
+    obj->put(1, 1);
+    cout << "obj->put(2, 2);" << endl;
+    obj->put(2, 2);
+    int param_1 = obj->get(1);
+    cout << "int param_1 = obj->get(1); " << param_1 << endl;
+    cout << "obj->put(3, 3);" << endl;
+    obj->put(3, 3);
+    int param_2 = obj->get(2);
+    cout << "int param_2 = obj->get(2); " << param_2 << endl;
+    int param_3 = obj->get(3);
+    cout << "int param_3 = obj->get(3); " << param_3 << endl;
+    cout << "obj->put(4, 4);" << endl;
+    obj->put(4, 4);
+    int param_4 = obj->get(1);
+    cout << "int param_4 = obj->get(1); " << param_4 << endl;
+    int param_5 = obj->get(3);
+    cout << "int param_5 = obj->get(3); " << param_5 << endl;
+    int param_6 = obj->get(4);
+    cout << "int param_6 = obj->get(4); " << param_6 << endl;
+    delete obj;
+    cout << endl;
+
+    checkAgainstReference(0, 10, 1000);
+    checkAgainstReference(1, 10, 10000);
+    checkAgainstReference(10, 30, 100000);
+    checkAgainstReference(1000, 3000, 200000);
+    cout << "Same results as the sorted-list LFUCache." << endl << endl;
+
+    cout << "Benchmark (25% put / 75% get, skewed keys):" << endl;
+    for (int capacity : {1000, 10000}) {
+        cout << "capacity " << capacity << ": sorted list "
+             << benchmark<SortedListLFUCache>(capacity, 200000) << " ns/op" << endl;
+    }
+    for (int capacity : {1000, 10000, 100000, 1000000, 10000000}) {
+        cout << "capacity " << capacity << ": buckets "
+             << benchmark<LFUCache>(capacity, 5000000) << " ns/op" << endl;
+    }
+    cout << "(checksum " << checksum << ")" << endl;
+    return 0;
+}
@@ -0,0 +1,395 @@
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+struct Entry {
+    int key;
+    int value;
+    int numHits;
+};
+
+typedef list<Entry>::iterator entryIt;
+
+// O(1) LFUCache of p460v3_LFUCache_buckets.cpp: the current policy, with
+// unbounded and never decayed hit counts.
+class LFUCache {
+public:
+    LFUCache(int capacity) : _capacity(capacity), _minHits(0) {
+        _cache.reserve(capacity);
+    }
+    int get(int key);
+    void put(int key, int value);
+
+private:
+    void _touch(entryIt& it);
+
+    int _capacity;
+
+    // Lowest hit count of any entry in the cache: its bucket holds the next
+    // element to be evicted.
+    int _minHits;
+
+    // Maps a hit count to the entries with that count, least recently used first.
+    // Empty buckets are removed.
+    unordered_map<int, list<Entry>> _buckets;
+
+    // Maps a key to a pointer in its bucket.
+    unordered_map<int, entryIt> _cache;
+};
+
+// Counts a hit on the entry pointed by the provided iterator: move it to the back
+// of the next bucket.
+void LFUCache::_touch(entryIt& it) {
+    int hits = it->numHits;
+    list<Entry>& from = _buckets[hits];
+    list<Entry>& to = _buckets[hits + 1];
+
+    // Splicing keeps the node (and thus the iterator in _cache) valid.
+    to.splice(to.end(), from, it);
+    it->numHits++;
+
+    if (from.empty()) {
+        _buckets.erase(hits);
+        if (_minHits == hits) {
+            _minHits = hits + 1;
+        }
+    }
+}
+
+int LFUCache::get(int key) {
+    unordered_map<int, entryIt>::iterator mIt = _cache.find(key);
+    if (mIt == _cache.end()) {
+        // Cache miss.
+        return -1;
+    }
+
+    _touch(mIt->second);
+    return mIt->second->value;
+}
+
+void LFUCache::put(int key, int value) {
+    if (_capacity <= 0) {
+        return;
+    }
+
+    unordered_map<int, entryIt>::iterator mIt = _cache.find(key);
+    if (mIt != _cache.end()) {
+        // Update existing value.
+        mIt->second->value = value;
+        _touch(mIt->second);
+        return;
+    }
+
+    if (_cache.size() == _capacity) {
+        // We are at max capacity: remove the LFU element before inserting a new value.
+        list<Entry>& bucket = _buckets[_minHits];
+        _cache.erase(bucket.front().key);
+        bucket.pop_front();
+        if (bucket.empty()) {
+            _buckets.erase(_minHits);
+        }
+    }
+
+    // A new entry has the lowest possible count.
+    list<Entry>& bucket = _buckets[1];
+    bucket.push_back(Entry{key, value, 1});
+    _cache[key] = prev(bucket.end());
+    _minHits = 1;
+}
+
+
+// Approximate access frequency of every key ever seen, in a fixed amount of
+// memory: a count-min sketch of 4 rows of 4-bit-range counters (capped at 15).
+// The estimate of a key is the minimum of its 4 counters, so it can only be
+// over-estimated, by hash collisions.
+//
+// After sampleSize increments all counters are halved: old popularity decays
+// exponentially, so keys that stopped being hot lose their advantage.
+class FrequencySketch {
+public:
+    FrequencySketch(int capacity) : _additions(0) {
+        size_t width = 64;
+        while (width < static_cast<size_t>(capacity)) {
+            width <<= 1;
+        }
+        _mask = width - 1;
+        _table.assign(ROWS * width, 0);
+        _sampleSize = 10 * max(capacity, 1);
+    }
+
+    void increment(int key) {
+        bool added = false;
+        for (int row = 0; row < ROWS; ++row) {
+            uint8_t& counter = _table[_index(key, row)];
+            if (counter < MAX_COUNT) {
+                ++counter;
+                added = true;
+            }
+        }
+        if (added && ++_additions == _sampleSize) {
+            _halve();
+        }
+    }
+
+    int estimate(int key) const {
+        int freq = MAX_COUNT;
+        for (int row = 0; row < ROWS; ++row) {
+            freq = min(freq, static_cast<int>(_table[_index(key, row)]));
+        }
+        return freq;
+    }
+
+private:
+    static const int ROWS = 4;
+    static const uint8_t MAX_COUNT = 15;
+
+    size_t _index(int key, int row) const {
+        static const uint64_t SEEDS[ROWS] = {
+            0x9E3779B97F4A7C15ull, 0xC2B2AE3D27D4EB4Full, 0x165667B19E3779F9ull, 0xD6E8FEB86659FD93ull};
+        uint64_t h = (static_cast<uint64_t>(static_cast<uint32_t>(key)) + row) * SEEDS[row];
+        h ^= h >> 32;
+        return row * (_mask + 1) + (h & _mask);
+    }
+
+    void _halve() {
+        for (uint8_t& counter : _table) {
+            counter >>= 1;
+        }
+        _additions /= 2;
+    }
+
+    vector<uint8_t> _table;
+    size_t _mask;
+    int _additions;
+    int _sampleSize;
+};
+
+// LFU-like cache with aged frequencies (W-TinyLFU), with the get/put interface
+// of LFUCache:
+// * new entries go to a small window LRU (1% of the capacity), so that bursts of
+//   new keys can build up some frequency before they have to compete;
+// * the main region is a segmented LRU: entries start in probation, and move to
+//   protected (80% of the main region) when they are hit again;
+// * when the window overflows, its LRU entry is admitted into the main region
+//   only if the sketch says that it is more popular than the entry it would
+//   evict (the LRU of probation). Otherwise it is dropped.
+// Frequencies come from the FrequencySketch, which ages them: unlike LFUCache,
+// yesterday's hot keys do not stay pinned forever.
+class TinyLFUCache {
+public:
+    TinyLFUCache(int capacity) : _sketch(capacity) {
+        _windowCapacity = capacity > 0 ? max(1, capacity / 100) : 0;
+        int mainCapacity = capacity - _windowCapacity;
+        _protectedCapacity = mainCapacity * 8 / 10;
+        _mainCapacity = mainCapacity;
+        _cache.reserve(capacity);
+    }
+
+    int get(int key) {
+        _sketch.increment(key);
+        unordered_map<int, Node>::iterator it = _cache.find(key);
+        if (it == _cache.end()) {
+            return -1;
+        }
+        _onHit(it->second);
+        return it->second.it->second;
+    }
+
+    void put(int key, int value) {
+        _sketch.increment(key);
+        if (_windowCapacity == 0) {
+            return;
+        }
+
+        unordered_map<int, Node>::iterator it = _cache.find(key);
+        if (it != _cache.end()) {
+            it->second.it->second = value;
+            _onHit(it->second);
+            return;
+        }
+
+        _window.emplace_back(key, value);
+        _cache[key] = Node{WINDOW, prev(_window.end())};
+        if (_window.size() > _windowCapacity) {
+            _evictFromWindow();
+        }
+    }
+
+private:
+    enum Segment { WINDOW, PROBATION, PROTECTED };
+
+    struct Node {
+        Segment segment;
+        list<pair<int, int>>::iterator it;
+    };
+
+    list<pair<int, int>>& _list(Segment segment) {
+        return segment == WINDOW ? _window : segment == PROBATION ? _probation : _protected;
+    }
+
+    void _onHit(Node& node) {
+        if (node.segment == PROBATION) {
+            // Second hit in the main region: promote to protected, and demote the
+            // LRU of protected if it is now too big.
+            _protected.splice(_protected.end(), _probation, node.it);
+            node.segment = PROTECTED;
+            if (_protected.size() > _protectedCapacity) {
+                list<pair<int, int>>::iterator demoted = _protected.begin();
+                _cache[demoted->first].segment = PROBATION;
+                _probation.splice(_probation.end(), _protected, demoted);
+            }
+        } else {
+            list<pair<int, int>>& l = _list(node.segment);
+            l.splice(l.end(), l, node.it);
+        }
+    }
+
+    // The window is over capacity: its LRU entry (the candidate) either enters
+    // the main region or leaves the cache.
+    void _evictFromWindow() {
+        list<pair<int, int>>::iterator candidate = _window.begin();
+        if (_probation.size() + _protected.size() < _mainCapacity) {
+            _admit(candidate);
+            return;
+        }
+
+        list<pair<int, int>>& victims = _probation.empty() ? _protected : _probation;
+        if (victims.empty()) {
+            // No main region at all (tiny capacities).
+            _cache.erase(candidate->first);
+            _window.erase(candidate);
+            return;
+        }
+        list<pair<int, int>>::iterator victim = victims.begin();
+        if (_sketch.estimate(candidate->first) > _sketch.estimate(victim->first)) {
+            _cache.erase(victim->first);
+            victims.erase(victim);
+            _admit(candidate);
+        } else {
+            _cache.erase(candidate->first);
+            _window.erase(candidate);
+        }
+    }
+
+    void _admit(list<pair<int, int>>::iterator candidate) {
+        _probation.splice(_probation.end(), _window, candidate);
+        _cache[candidate->first].segment = PROBATION;
+    }
+
+    FrequencySketch _sketch;
+
+    size_t _windowCapacity;
+    size_t _mainCapacity;
+    size_t _protectedCapacity;
+
+    // Each list is in LRU order: front is the least recently used entry.
+    list<pair<int, int>> _window;
+    list<pair<int, int>> _probation;
+    list<pair<int, int>> _protected;
+
+    unordered_map<int, Node> _cache;
+};
+
+struct XorShift {
+    uint64_t s;
+    XorShift(uint64_t seed) : s(seed) {}
+    uint64_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+class ZipfGenerator {
+public:
+    ZipfGenerator(int n, double theta) : _cdf(n) {
+        double sum = 0.0;
+        for (int k = 0; k < n; ++k) {
+            sum += 1.0 / pow(k + 1, theta);
+            _cdf[k] = sum;
+        }
+        for (double& c : _cdf) {
+            c /= sum;
+        }
+    }
+
+    int next(XorShift& rng) {
+        double u = (rng.next() >> 11) * (1.0 / 9007199254740992.0);
+        return lower_bound(_cdf.begin(), _cdf.end(), u) - _cdf.begin();
+    }
+
+private:
+    vector<double> _cdf;
+};
+
+// Zipfian popularity over numKeys keys. Every phaseLength requests the ranking
+// moves to a new set of keys: the old hot keys become cold at once.
+vector<int> shiftingZipfTrace(int numKeys, int length, int phaseLength, uint64_t seed) {
+    ZipfGenerator zipf(numKeys, 0.9);
+    XorShift rng(seed);
+    vector<int> trace(length);
+    for (int i = 0; i < length; ++i) {
+        int phase = i / phaseLength;
+        // Spread the ranks over the key space, with a different offset per phase.
+        int rank = zipf.next(rng);
+        trace[i] = static_cast<int>((static_cast<uint64_t>(rank) * 2654435761u + phase * 7919u) % (4u * numKeys));
+    }
+    return trace;
+}
+
+// Read-through replay: get, and put on a miss. Returns the hit ratio in %.
+template <typename Cache>
+double hitRatio(vector<int> const & trace, int capacity) {
+    Cache cache(capacity);
+    long long hits = 0;
+    for (int key : trace) {
+        if (cache.get(key) != -1) {
+            ++hits;
+        } else {
+            cache.put(key, key);
+        }
+    }
+    return 100.0 * hits / trace.size();
+}
+
+int main() {
+    int capacity = 2;
+    TinyLFUCache* obj = new TinyLFUCache(capacity);
+    cout << "obj->put(1, 1);" << endl;
+    obj->put(1, 1);
+    cout << "obj->put(2, 2);" << endl;
+    obj->put(2, 2);
+    int param_1 = obj->get(1);
+    cout << "int param_1 = obj->get(1); " << param_1 << endl;
+    cout << "obj->put(3, 3);" << endl;
+    obj->put(3, 3);
+    int param_2 = obj->get(2);
+    cout << "int param_2 = obj->get(2); " << param_2 << endl;
+    int param_3 = obj->get(3);
+    cout << "int param_3 = obj->get(3); " << param_3 << endl;
+    delete obj;
+    cout << endl;
+
+    int numKeys = 100000;
+    int length = 4000000;
+    int cacheCapacity = 5000;
+    cout << "Hit ratio (Zipf 0.9 over " << numKeys << " keys, capacity " << cacheCapacity << "):" << endl;
+    cout << "phase length   LFU       W-TinyLFU" << endl;
+    for (int phaseLength : {length, 1000000, 200000, 50000}) {
+        vector<int> trace = shiftingZipfTrace(numKeys, length, phaseLength, phaseLength);
+        cout << (phaseLength == length ? string("static    ") : to_string(phaseLength)) << "\t" << "     "
+             << hitRatio<LFUCache>(trace, cacheCapacity) << "%\t"
+             << hitRatio<TinyLFUCache>(trace, cacheCapacity) << "%" << endl;
+    }
+    return 0;
+}
@@ -0,0 +1,499 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Eviction order of the O(1) LFUCache of p460v3_LFUCache_buckets.cpp, for keys
+// only: buckets of keys per hit count, each in LRU order. Not thread-safe.
+class LFUOrder {
+public:
+    static const int NONE = INT_MIN;
+
+    // Counts a hit on the key, if it is tracked.
+    void touch(int key) {
+        unordered_map<int, list<Entry>::iterator>::iterator mIt = _index.find(key);
+        if (mIt == _index.end()) {
+            return;
+        }
+        list<Entry>::iterator it = mIt->second;
+        int hits = it->numHits;
+        list<Entry>& from = _buckets[hits];
+        list<Entry>& to = _buckets[hits + 1];
+        to.splice(to.end(), from, it);
+        it->numHits++;
+        if (from.empty()) {
+            _buckets.erase(hits);
+            if (_minHits == hits) {
+                _minHits = hits + 1;
+            }
+        }
+    }
+
+    // Removes and returns the LFU key (LRU among the least frequent ones).
+    int evict() {
+        list<Entry>& bucket = _buckets[_minHits];
+        int key = bucket.front().key;
+        _index.erase(key);
+        bucket.pop_front();
+        if (bucket.empty()) {
+            _buckets.erase(_minHits);
+        }
+        return key;
+    }
+
+    void insert(int key) {
+        list<Entry>& bucket = _buckets[1];
+        bucket.push_back(Entry{key, 1});
+        _index[key] = prev(bucket.end());
+        _minHits = 1;
+    }
+
+    size_t size() const {
+        return _index.size();
+    }
+
+private:
+    struct Entry {
+        int key;
+        int numHits;
+    };
+
+    int _minHits = 0;
+    unordered_map<int, list<Entry>> _buckets;
+    unordered_map<int, list<Entry>::iterator> _index;
+};
+
+// Thread-safe LFU cache whose reads never take a lock in the common case.
+//
+// * Keys and values live in an open-addressing table of 64-bit words, one
+//   (key, value) pair per word, so a reader finds and reads an entry with plain
+//   atomic loads. The table is only written under the maintenance lock.
+// * A hit does not touch the frequency structure. It is recorded in one of the
+//   striped read buffers (each thread always uses the same stripe), and the
+//   buffered hits are applied in batches by whichever thread holds the
+//   maintenance lock: a put, or a reader whose buffer is full and that manages
+//   to try_lock it. The buffers are lossy: when one is full and the lock is
+//   busy, the hit is dropped, which only makes the frequencies approximate.
+// * Deleted entries leave tombstones, so an entry never moves while readers may
+//   be probing for it. When tombstones pile up the table is rebuilt in place,
+//   inside a seqlock: readers that overlap a rebuild see the sequence change and
+//   retry.
+//
+// Key INT_MIN is reserved to mark empty and deleted slots.
+class ConcurrentLFUCache {
+public:
+    ConcurrentLFUCache(int capacity) : _capacity(capacity), _tombstones(0), _seq(0) {
+        size_t numSlots = 16;
+        while (numSlots < 2 * static_cast<size_t>(max(capacity, 1))) {
+            numSlots <<= 1;
+        }
+        _numSlots = numSlots;
+        _slots.reset(new atomic<uint64_t>[numSlots]);
+        for (size_t i = 0; i < numSlots; ++i) {
+            _slots[i].store(EMPTY, memory_order_relaxed);
+        }
+        for (ReadBuffer& buffer : _buffers) {
+            for (atomic<int64_t>& slot : buffer.keys) {
+                slot.store(NO_KEY, memory_order_relaxed);
+            }
+        }
+    }
+
+    int get(int key) {
+        assert(key != INT_MIN);
+        uint64_t word;
+        while (true) {
+            uint64_t seq = _seq.load(memory_order_acquire);
+            if (seq & 1) {
+                // A rebuild is in progress.
+                this_thread::yield();
+                continue;
+            }
+            word = _find(key);
+            atomic_thread_fence(memory_order_acquire);
+            if (_seq.load(memory_order_relaxed) == seq) {
+                break;
+            }
+        }
+        if (word == EMPTY) {
+            return -1;
+        }
+
+        _recordHit(key);
+        return _valueOf(word);
+    }
+
+    void put(int key, int value) {
+        assert(key != INT_MIN);
+        if (_capacity <= 0) {
+            return;
+        }
+
+        lock_guard<mutex> lock(_mtx);
+        _drainBuffers();
+
+        size_t slot = _probe(key);
+        uint64_t word = _pack(key, value);
+        if (_slots[slot].load(memory_order_relaxed) != EMPTY
+            && _slots[slot].load(memory_order_relaxed) != TOMBSTONE) {
+            // Existing key: update the value and count a hit.
+            _slots[slot].store(word, memory_order_release);
+            _order.touch(key);
+            return;
+        }
+
+        if (static_cast<int>(_order.size()) == _capacity) {
+            int victim = _order.evict();
+            _slots[_probe(victim)].store(TOMBSTONE, memory_order_release);
+            ++_tombstones;
+        }
+
+        // Reuse the first tombstone on the probe path, if any: readers looking
+        // for other keys just skip over the slot.
+        size_t target = _firstFree(key);
+        if (_slots[target].load(memory_order_relaxed) == TOMBSTONE) {
+            --_tombstones;
+        }
+        _slots[target].store(word, memory_order_release);
+        _order.insert(key);
+
+        if (_order.size() + _tombstones > _numSlots * 3 / 4) {
+            _rebuild();
+        }
+    }
+
+private:
+    static constexpr uint64_t EMPTY = static_cast<uint64_t>(0x80000000u) << 32;
+    static constexpr uint64_t TOMBSTONE = EMPTY | 1;
+    static constexpr int64_t NO_KEY = INT64_MIN;
+
+    static const int NUM_STRIPES = 16;
+    static const int BUFFER_SIZE = 64;
+
+    struct alignas(64) ReadBuffer {
+        atomic<uint32_t> writeCount{0};
+        // Only written under the maintenance lock.
+        atomic<uint32_t> readCount{0};
+        atomic<int64_t> keys[BUFFER_SIZE];
+    };
+
+    static uint64_t _pack(int key, int value) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(key)) << 32) | static_cast<uint32_t>(value);
+    }
+
+    static int _keyOf(uint64_t word) {
+        return static_cast<int>(static_cast<uint32_t>(word >> 32));
+    }
+
+    static int _valueOf(uint64_t word) {
+        return static_cast<int>(static_cast<uint32_t>(word));
+    }
+
+    size_t _home(int key) const {
+        uint64_t h = static_cast<uint64_t>(static_cast<uint32_t>(key)) * 0x9E3779B97F4A7C15ull;
+        return (h >> 32) & (_numSlots - 1);
+    }
+
+    // Lock-free lookup: returns the word of the key, or EMPTY.
+    uint64_t _find(int key) const {
+        size_t slot = _home(key);
+        for (size_t n = 0; n < _numSlots; ++n) {
+            uint64_t word = _slots[slot].load(memory_order_acquire);
+            if (word == EMPTY) {
+                return EMPTY;
+            }
+            if (word != TOMBSTONE && _keyOf(word) == key) {
+                return word;
+            }
+            slot = (slot + 1) & (_numSlots - 1);
+        }
+        return EMPTY;
+    }
+
+    // Under the lock: slot holding the key, or the empty slot ending its probe path.
+    size_t _probe(int key) const {
+        size_t slot = _home(key);
+        while (true) {
+            uint64_t word = _slots[slot].load(memory_order_relaxed);
+            if (word == EMPTY || (word != TOMBSTONE && _keyOf(word) == key)) {
+                return slot;
+            }
+            slot = (slot + 1) & (_numSlots - 1);
+        }
+    }
+
+    // Under the lock, for a key that is not in the table: first reusable slot.
+    size_t _firstFree(int key) const {
+        size_t slot = _home(key);
+        while (true) {
+            uint64_t word = _slots[slot].load(memory_order_relaxed);
+            if (word == EMPTY || word == TOMBSTONE) {
+                return slot;
+            }
+            slot = (slot + 1) & (_numSlots - 1);
+        }
+    }
+
+    // Reinserts all the live entries, dropping the tombstones. O(capacity), but
+    // only once every ~capacity/2 evictions.
+    void _rebuild() {
+        vector<uint64_t> live;
+        live.reserve(_order.size());
+        for (size_t i = 0; i < _numSlots; ++i) {
+            uint64_t word = _slots[i].load(memory_order_relaxed);
+            if (word != EMPTY && word != TOMBSTONE) {
+                live.push_back(word);
+            }
+        }
+
+        _seq.fetch_add(1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        for (size_t i = 0; i < _numSlots; ++i) {
+            _slots[i].store(EMPTY, memory_order_relaxed);
+        }
+        for (uint64_t word : live) {
+            _slots[_firstFree(_keyOf(word))].store(word, memory_order_relaxed);
+        }
+        _tombstones = 0;
+        _seq.fetch_add(1, memory_order_release);
+    }
+
+    ReadBuffer& _myBuffer() {
+        static atomic<int> nextStripe(0);
+        thread_local int stripe = nextStripe.fetch_add(1) % NUM_STRIPES;
+        return _buffers[stripe];
+    }
+
+    void _recordHit(int key) {
+        ReadBuffer& buffer = _myBuffer();
+        uint32_t w = buffer.writeCount.load(memory_order_relaxed);
+        // readCount may be stale: at worst the buffer looks fuller than it is.
+        uint32_t r = buffer.readCount.load(memory_order_relaxed);
+        if (w - r < BUFFER_SIZE && buffer.writeCount.compare_exchange_weak(w, w + 1, memory_order_relaxed)) {
+            buffer.keys[w % BUFFER_SIZE].store(key, memory_order_release);
+            if (w - r + 1 < BUFFER_SIZE) {
+                return;
+            }
+        }
+
+        // Full (or lost the race): drain if nobody else is doing maintenance,
+        // otherwise drop the hit.
+        unique_lock<mutex> lock(_mtx, try_to_lock);
+        if (lock.owns_lock()) {
+            _drainBuffers();
+        }
+    }
+
+    // Under the lock: applies all the buffered hits to the frequency structure.
+    void _drainBuffers() {
+        for (ReadBuffer& buffer : _buffers) {
+            uint32_t w = buffer.writeCount.load(memory_order_acquire);
+            uint32_t r = buffer.readCount.load(memory_order_relaxed);
+            for (; r != w; ++r) {
+                // A slot whose writer has not stored its key yet reads as NO_KEY:
+                // that hit is lost.
+                int64_t key = buffer.keys[r % BUFFER_SIZE].exchange(NO_KEY, memory_order_acquire);
+                if (key != NO_KEY) {
+                    _order.touch(static_cast<int>(key));
+                }
+            }
+            buffer.readCount.store(r, memory_order_relaxed);
+        }
+    }
+
+    int _capacity;
+
+    // Maintenance lock: guards _order, the read counts of the buffers, and all the
+    // writes to the table.
+    mutex _mtx;
+    LFUOrder _order;
+
+    unique_ptr<atomic<uint64_t>[]> _slots;
+    size_t _numSlots;
+    size_t _tombstones;
+
+    // Odd while the table is being rebuilt.
+    atomic<uint64_t> _seq;
+
+    ReadBuffer _buffers[NUM_STRIPES];
+};
+
+// The O(1) LFUCache behind one global mutex: every get takes the lock.
+class GlobalLockLFUCache {
+public:
+    GlobalLockLFUCache(int capacity) : _capacity(capacity) {}
+
+    int get(int key) {
+        lock_guard<mutex> lock(_mtx);
+        unordered_map<int, int>::iterator it = _values.find(key);
+        if (it == _values.end()) {
+            return -1;
+        }
+        _order.touch(key);
+        return it->second;
+    }
+
+    void put(int key, int value) {
+        if (_capacity <= 0) {
+            return;
+        }
+        lock_guard<mutex> lock(_mtx);
+        unordered_map<int, int>::iterator it = _values.find(key);
+        if (it != _values.end()) {
+            it->second = value;
+            _order.touch(key);
+            return;
+        }
+        if (static_cast<int>(_values.size()) == _capacity) {
+            _values.erase(_order.evict());
+        }
+        _values[key] = value;
+        _order.insert(key);
+    }
+
+private:
+    int _capacity;
+    mutex _mtx;
+    LFUOrder _order;
+    unordered_map<int, int> _values;
+};
+
+struct XorShift {
+    uint64_t s;
+    XorShift(uint64_t seed) : s(seed) {}
+    uint64_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+// numThreads workers on the same cache, each with its own Zipfian key stream:
+// 99% get, 1% put. Returns the total throughput in Mops/s.
+template <typename Cache>
+double benchmark(Cache& cache, vector<vector<int>> const & keys, int numThreads) {
+    atomic<bool> go(false);
+    atomic<long long> checksum(0);
+    vector<thread> workers;
+    for (int t = 0; t < numThreads; ++t) {
+        workers.emplace_back([&, t]() {
+            vector<int> const & myKeys = keys[t];
+            long long sum = 0;
+            while (!go.load()) {
+                this_thread::yield();
+            }
+            for (size_t i = 0; i < myKeys.size(); ++i) {
+                if (i % 100 == 0) {
+                    cache.put(myKeys[i], static_cast<int>(i));
+                } else {
+                    sum += cache.get(myKeys[i]);
+                }
+            }
+            checksum += sum;
+        });
+    }
+
+    auto start = chrono::steady_clock::now();
+    go = true;
+    for (thread& w : workers) {
+        w.join();
+    }
+    auto end = chrono::steady_clock::now();
+    return numThreads * keys[0].size() / chrono::duration<double>(end - start).count() / 1e6;
+}
+
+int main() {
+    int capacity = 2;
+    ConcurrentLFUCache* obj = new ConcurrentLFUCache(capacity);
+    cout << "obj->put(1, 1);" << endl;
+    obj->put(1, 1);
+    cout << "obj->put(2, 2);" << endl;
+    obj->put(2, 2);
+    int param_1 = obj->get(1);
+    cout << "int param_1 = obj->get(1); " << param_1 << endl;
+    cout << "obj->put(3, 3);" << endl;
+    obj->put(3, 3);
+    int param_2 = obj->get(2);
+    cout << "int param_2 = obj->get(2); " << param_2 << endl;
+    int param_3 = obj->get(3);
+    cout << "int param_3 = obj->get(3); " << param_3 << endl;
+    assert(param_1 == 1 && param_2 == -1 && param_3 == 3);
+    delete obj;
+    cout << endl;
+
+    // Concurrent sanity check: values read are always ones that were put.
+    {
+        ConcurrentLFUCache cache(1000);
+        vector<thread> workers;
+        for (int t = 0; t < 8; ++t) {
+            workers.emplace_back([&cache, t]() {
+                XorShift rng(t + 1);
+                for (int i = 0; i < 200000; ++i) {
+                    int key = rng.next() % 5000;
+                    if (i % 10 == 0) {
+                        cache.put(key, key * 3);
+                    } else {
+                        int value = cache.get(key);
+                        assert(value == -1 || value == key * 3);
+                    }
+                }
+            });
+        }
+        for (thread& w : workers) {
+            w.join();
+        }
+        cout << "Concurrent check passed." << endl << endl;
+    }
+
+    int numKeys = 1000000;
+    int cacheCapacity = 100000;
+    int opsPerThread = 200000;
+    int maxThreads = 64;
+
+    vector<double> cdf(numKeys);
+    double sum = 0.0;
+    for (int k = 0; k < numKeys; ++k) {
+        sum += 1.0 / pow(k + 1, 0.99);
+        cdf[k] = sum;
+    }
+    vector<vector<int>> keys(maxThreads, vector<int>(opsPerThread));
+    for (int t = 0; t < maxThreads; ++t) {
+        XorShift rng(t + 1);
+        for (int& key : keys[t]) {
+            double u = (rng.next() >> 11) * (1.0 / 9007199254740992.0) * sum;
+            key = lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+        }
+    }
+
+    cout << "Benchmark (Zipf 0.99 over " << numKeys << " keys, capacity " << cacheCapacity
+         << ", 99% get / 1% put), hardware threads: " << thread::hardware_concurrency() << endl;
+    cout << "threads  global lock (Mops/s)  buffered reads (Mops/s)" << endl;
+    for (int numThreads = 1; numThreads <= maxThreads; numThreads *= 2) {
+        GlobalLockLFUCache global(cacheCapacity);
+        ConcurrentLFUCache concurrent(cacheCapacity);
+        // Warm both up so that most gets hit.
+        for (int k = 0; k < cacheCapacity; ++k) {
+            global.put(k, k);
+            concurrent.put(k, k);
+        }
+        double globalMops = benchmark(global, keys, numThreads);
+        double concurrentMops = benchmark(concurrent, keys, numThreads);
+        cout << numThreads << "\t " << globalMops << "\t\t\t" << concurrentMops << endl;
+    }
+    return 0;
+}
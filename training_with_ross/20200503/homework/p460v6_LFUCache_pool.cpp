@@ -0,0 +1,400 @@
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <new>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Calls to the global allocator made by NodeArena and PoolAllocator (chunks,
+// bucket arrays, and every node when there is no arena), so that main() can
+// check that the steady state of the pooled cache never allocates.
+static long long numAllocations = 0;
+
+// Fixed-size block pools for the nodes of one container (or of a few containers
+// that live and die together). There is one pool per block size, and each pool
+// carves its blocks out of chunks of blocksPerChunk blocks; freed blocks go to a
+// free list and are handed out again before any new chunk is allocated. Memory
+// only goes back to the system when the arena is destroyed.
+class NodeArena {
+public:
+    NodeArena(size_t blocksPerChunk) : _blocksPerChunk(max<size_t>(blocksPerChunk, 1)) {}
+
+    NodeArena(NodeArena const &) = delete;
+    NodeArena& operator=(NodeArena const &) = delete;
+
+    ~NodeArena() {
+        for (Pool& pool : _pools) {
+            for (void* chunk : pool.chunks) {
+                ::operator delete(chunk);
+            }
+        }
+    }
+
+    void* allocate(size_t size) {
+        Pool& pool = _poolFor(size);
+        if (pool.freeList == nullptr) {
+            _grow(pool);
+        }
+        FreeBlock* block = pool.freeList;
+        pool.freeList = block->next;
+        ++numLive;
+        return block;
+    }
+
+    void deallocate(void* p, size_t size) {
+        Pool& pool = _poolFor(size);
+        FreeBlock* block = static_cast<FreeBlock*>(p);
+        block->next = pool.freeList;
+        pool.freeList = block;
+        --numLive;
+    }
+
+    // Blocks currently handed out, and chunks taken from the global allocator.
+    long long numLive = 0;
+    long long numChunks = 0;
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct Pool {
+        size_t blockSize;
+        FreeBlock* freeList;
+        vector<void*> chunks;
+    };
+
+    static size_t _roundUp(size_t size) {
+        size_t align = alignof(max_align_t);
+        size = max(size, sizeof(FreeBlock));
+        return (size + align - 1) / align * align;
+    }
+
+    // A container only uses a couple of node sizes: a linear search is enough.
+    Pool& _poolFor(size_t size) {
+        size_t blockSize = _roundUp(size);
+        for (Pool& pool : _pools) {
+            if (pool.blockSize == blockSize) {
+                return pool;
+            }
+        }
+        _pools.push_back(Pool{blockSize, nullptr, {}});
+        return _pools.back();
+    }
+
+    // Allocates a new chunk and threads all its blocks into the free list.
+    void _grow(Pool& pool) {
+        char* chunk = static_cast<char*>(::operator new(pool.blockSize * _blocksPerChunk));
+        ++numAllocations;
+        pool.chunks.push_back(chunk);
+        ++numChunks;
+        for (size_t i = _blocksPerChunk; i-- > 0;) {
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(chunk + i * pool.blockSize);
+            block->next = pool.freeList;
+            pool.freeList = block;
+        }
+    }
+
+    size_t _blocksPerChunk;
+    vector<Pool> _pools;
+};
+
+// Standard allocator interface over a NodeArena. Single-object requests (the
+// nodes of lists and hash maps) come from the arena; arrays (the bucket array of
+// a hash map) and everything, if there is no arena, go to the global allocator.
+template <typename T>
+class PoolAllocator {
+public:
+    typedef T value_type;
+
+    PoolAllocator(NodeArena* arena) : _arena(arena) {}
+
+    template <typename U>
+    PoolAllocator(PoolAllocator<U> const & other) : _arena(other.arena()) {}
+
+    T* allocate(size_t n) {
+        if (_arena != nullptr && n == 1) {
+            return static_cast<T*>(_arena->allocate(sizeof(T)));
+        }
+        ++numAllocations;
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) {
+        if (_arena != nullptr && n == 1) {
+            _arena->deallocate(p, sizeof(T));
+        } else {
+            ::operator delete(p);
+        }
+    }
+
+    NodeArena* arena() const {
+        return _arena;
+    }
+
+    template <typename U>
+    bool operator==(PoolAllocator<U> const & rhs) const {
+        return _arena == rhs.arena();
+    }
+
+    template <typename U>
+    bool operator!=(PoolAllocator<U> const & rhs) const {
+        return _arena != rhs.arena();
+    }
+
+private:
+    NodeArena* _arena;
+};
+
+struct Entry {
+    int key;
+    int value;
+    int numHits;
+    int lastHit;
+
+    bool operator<(Entry const & rhs) const {
+        // The "lower" entry is the one with more priority to be evicted:
+        // * least frequently used;
+        // * least recently used.
+        if (numHits < rhs.numHits) {
+            return true;
+        } else if (numHits > rhs.numHits) {
+            return false;
+        } else {
+            return lastHit < rhs.lastHit;
+        }
+    }
+};
+
+typedef list<Entry, PoolAllocator<Entry>> entryList;
+typedef entryList::iterator entryIt;
+typedef unordered_map<int, entryIt, hash<int>, equal_to<int>,
+                      PoolAllocator<pair<int const, entryIt>>> entryMap;
+
+// LFUCache of p460_LFUCache.cpp whose list and map nodes come from a NodeArena
+// sized from the capacity. The cache never holds more than capacity nodes of
+// each kind (evictions happen before inserts, and _update erases before it
+// re-inserts), so after the first put has created the pools, insert/evict
+// cycles only recycle blocks. The bucket array of the map is sized once in the
+// constructor. pooled = false uses the global allocator, for comparison.
+class LFUCache {
+public:
+    LFUCache(int capacity, bool pooled = true)
+        : _capacity(capacity), _count(0), _arena(capacity),
+          _l(PoolAllocator<Entry>(pooled ? &_arena : nullptr)),
+          _cache(max(capacity, 1), PoolAllocator<pair<int const, entryIt>>(pooled ? &_arena : nullptr)) {}
+    int get(int key);
+    void put(int key, int value);
+
+    NodeArena const & arena() const {
+        return _arena;
+    }
+
+private:
+    void _update(entryIt& it);
+
+    int _capacity;
+    int _count;
+
+    // Declared before the containers, so that it outlives them.
+    NodeArena _arena;
+
+    // Stores all the elements in the cache in priority order: the front is always
+    // the next element to be evicted.
+    entryList _l;
+
+    // Maps a key to a pointer in the list.
+    entryMap _cache;
+};
+
+// Update the position of the element pointed by the provided iterator
+// in the list.
+void LFUCache::_update(entryIt& it) {
+    // When we erase we get an iterator to the next element, but we invalidate
+    // the erased iterator: make a copy of the entry first.
+    Entry entry(*it);
+    entryIt nextIt = _l.erase(it);
+
+    // Where should we insert this element back?
+    for (; nextIt != _l.end() && *nextIt < entry; ++nextIt) {}
+
+    it = _l.insert(nextIt, entry);
+}
+
+int LFUCache::get(int key) {
+    ++_count;
+    entryMap::iterator mIt = _cache.find(key);
+    if (mIt == _cache.end()) {
+        // Cache miss.
+        return -1;
+    }
+
+    // Element found: retrieve it, update it and return it.
+    entryIt& lIt = mIt->second;
+    lIt->numHits++;
+    lIt->lastHit = _count;
+    _update(lIt);
+    return lIt->value;
+}
+
+void LFUCache::put(int key, int value) {
+    ++_count;
+    if (_capacity == 0) {
+        return;
+    }
+
+    entryMap::iterator mIt = _cache.find(key);
+    if (mIt != _cache.end()) {
+        // Update existing value.
+        entryIt& lIt = mIt->second;
+        lIt->value = value;
+        lIt->numHits++;
+        lIt->lastHit = _count;
+        _update(lIt);
+    } else {
+        // Insert a new value.
+        if (_cache.size() == static_cast<size_t>(_capacity)) {
+            // We are at max capacity: remove the LFU element before inserting a new
+            // value, so that its nodes are free for the new one.
+            int lfuKey = _l.front().key;
+            _cache.erase(lfuKey);
+            _l.pop_front();
+        }
+
+        // Insert the new value in the list...
+        Entry entry;
+        entry.key = key;
+        entry.value = value;
+        entry.numHits = 1;
+        entry.lastHit = _count;
+        _l.push_front(entry);
+        entryIt lIt = _l.begin();
+        _update(lIt);
+
+        // ...and in the cache.
+        _cache.insert(pair<int, entryIt>(key, lIt));
+    }
+}
+
+struct XorShift {
+    uint64_t s;
+    XorShift(uint64_t seed) : s(seed) {}
+    uint64_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+// Sum of all the values read, printed at the end so that the compiler cannot
+// drop the benchmark loops.
+static long long checksum = 0;
+
+// High churn: keys drawn from 8x the capacity, so that most gets miss and most
+// puts evict. Fills the cache first, then measures the steady state: prints
+// ns/op and the number of allocations of the cache's containers.
+void benchmark(int capacity, int numOps, bool pooled) {
+    LFUCache cache(capacity, pooled);
+    XorShift rng(capacity);
+    vector<int> keys(numOps);
+    for (int& key : keys) {
+        key = rng.next() % (8 * capacity);
+    }
+    for (int k = 0; k < capacity; ++k) {
+        cache.put(8 * capacity + k, k);
+    }
+
+    long long allocsBefore = numAllocations;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < numOps; ++i) {
+        if (i & 1) {
+            checksum += cache.get(keys[i]);
+        } else {
+            cache.put(keys[i], i);
+        }
+    }
+    auto end = chrono::steady_clock::now();
+    long long allocs = numAllocations - allocsBefore;
+    if (pooled) {
+        assert(allocs == 0);
+        assert(cache.arena().numChunks == 2);
+    } else {
+        // The counter sees the allocations of the malloc cache.
+        assert(allocs > 0);
+    }
+
+    cout << "capacity " << capacity << (pooled ? ", pooled:  " : ", malloc:  ")
+         << chrono::duration<double, nano>(end - start).count() / numOps << " ns/op, "
+         << allocs << " allocations";
+    if (pooled) {
+        cout << " (" << cache.arena().numLive << " live blocks in "
+             << cache.arena().numChunks << " chunks)";
+    }
+    cout << endl;
+}
+
+int main() {
+    int capacity = 2;
+    LFUCache* obj = new LFUCache(capacity);
+
+    cout << "obj->put(1, 1);" << endl;
+    obj->put(1, 1);
+    cout << "obj->put(2, 2);" << endl;
+    obj->put(2, 2);
+    int param_1 = obj->get(1);
+    cout << "int param_1 = obj->get(1); " << param_1 << endl;
+    cout << "obj->put(3, 3);" << endl;
+    obj->put(3, 3);
+    int param_2 = obj->get(2);
+    cout << "int param_2 = obj->get(2); " << param_2 << endl;
+    int param_3 = obj->get(3);
+    cout << "int param_3 = obj->get(3); " << param_3 << endl;
+    cout << "obj->put(4, 4);" << endl;
+    obj->put(4, 4);
+    int param_4 = obj->get(1);
+    cout << "int param_4 = obj->get(1); " << param_4 << endl;
+    int param_5 = obj->get(3);
+    cout << "int param_5 = obj->get(3); " << param_5 << endl;
+    int param_6 = obj->get(4);
+    cout << "int param_6 = obj->get(4); " << param_6 << endl;
+    assert(param_4 == -1 && param_5 == 3 && param_6 == 4);
+    // One list node and one map node per entry.
+    assert(obj->arena().numLive == 4);
+    delete obj;
+    cout << endl;
+
+    // The pooled and the malloc caches must behave the same.
+    LFUCache pooled(100);
+    LFUCache plain(100, false);
+    XorShift rng(1);
+    for (int i = 0; i < 100000; ++i) {
+        uint64_t r = rng.next();
+        int key = (r >> 8) % 300;
+        if (r & 1) {
+            assert(pooled.get(key) == plain.get(key));
+        } else {
+            pooled.put(key, i);
+            plain.put(key, i);
+        }
+    }
+    cout << "Same results with and without the pool." << endl << endl;
+
+    cout << "Benchmark (50% get / 50% put, keys from 8x the capacity):" << endl;
+    // The sorted list makes every insert O(capacity): above ~1000 entries the
+    // list walk hides the allocator (p460v3_LFUCache_buckets.cpp removes it).
+    for (int c : {10, 100, 1000}) {
+        int numOps = 20000000 / c;
+        benchmark(c, numOps, false);
+        benchmark(c, numOps, true);
+    }
+    cout << "(checksum " << checksum << ")" << endl;
+    return 0;
+}
@@ -0,0 +1,770 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+static constexpr uint32_t NIL = 0xFFFFFFFFu;
+
+// Generic cache whose replacement policy is a template parameter. Storage is the
+// same for every policy: the entries live in one slab, and the key index is the
+// open-addressing table of p146v4_lru_cache_slab.cpp (32-bit slab indices, linear
+// probing, backward-shift deletion).
+//
+// The policy only sees slab indices, through three hooks that the compiler
+// inlines into get and put (no virtual calls):
+// * onInsert(idx): a new entry was stored at idx;
+// * onHit(idx): the entry at idx was read or overwritten;
+// * evict(): picks the victim, detaches it from the policy state and returns its
+//   index. The cache then reuses that slot for the entry being inserted.
+// Slots are handed out as 0, 1, ... until the cache is full, then only through
+// evict. Policies allocate all their state in init(capacity).
+template <typename K, typename V, typename Policy, typename Hash = hash<K>>
+class Cache {
+public:
+    Cache(int capacity) : _capacity(capacity), _size(0) {
+        assert(capacity >= 0);
+        _nodes.resize(capacity);
+
+        // Keep the load factor at or below 50% so that probe sequences stay short.
+        size_t numSlots = 1;
+        while (numSlots < 2 * static_cast<size_t>(capacity)) {
+            numSlots <<= 1;
+        }
+        _slots.assign(numSlots, NIL);
+        _mask = numSlots - 1;
+        _policy.init(capacity);
+    }
+
+    // Returns true and sets value if the key is in the cache.
+    bool get(K const & key, V& value) {
+        uint32_t idx = _slots[_findSlot(key)];
+        if (idx == NIL) {
+            return false;
+        }
+
+        _policy.onHit(idx);
+        value = _nodes[idx].value;
+        return true;
+    }
+
+    void put(K const & key, V const & value) {
+        if (_capacity == 0) {
+            return;
+        }
+
+        uint32_t slot = _findSlot(key);
+        uint32_t idx = _slots[slot];
+        if (idx != NIL) {
+            _nodes[idx].value = value;
+            _policy.onHit(idx);
+            return;
+        }
+
+        if (_size == _capacity) {
+            idx = _policy.evict();
+            _eraseSlot(_findSlot(_nodes[idx].key));
+
+            // Erasing may have shifted the entries after it: look the slot up again.
+            slot = _findSlot(key);
+        } else {
+            idx = _size++;
+        }
+
+        _nodes[idx].key = key;
+        _nodes[idx].value = value;
+        _policy.onInsert(idx);
+        _slots[slot] = idx;
+    }
+
+    int size() const {
+        return _size;
+    }
+
+private:
+    struct Node {
+        K key;
+        V value;
+    };
+
+    size_t _home(K const & key) const {
+        // Fibonacci hashing: spreads poor hashes (e.g. the identity for integers)
+        // over the whole table.
+        uint64_t h = static_cast<uint64_t>(_hash(key)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(h >> 32) & _mask;
+    }
+
+    // Returns the slot holding the key, or the empty slot where it would go.
+    uint32_t _findSlot(K const & key) const {
+        size_t slot = _home(key);
+        while (_slots[slot] != NIL && !(_nodes[_slots[slot]].key == key)) {
+            slot = (slot + 1) & _mask;
+        }
+        return static_cast<uint32_t>(slot);
+    }
+
+    // Backward-shift deletion: pull later entries of the probe sequence into the
+    // hole, so that lookups never need tombstones.
+    void _eraseSlot(size_t hole) {
+        size_t slot = hole;
+        while (true) {
+            slot = (slot + 1) & _mask;
+            uint32_t idx = _slots[slot];
+            if (idx == NIL) {
+                break;
+            }
+            // The entry may move into the hole only if its home is not in (hole, slot].
+            size_t home = _home(_nodes[idx].key);
+            if (((slot - home) & _mask) >= ((slot - hole) & _mask)) {
+                _slots[hole] = idx;
+                hole = slot;
+            }
+        }
+        _slots[hole] = NIL;
+    }
+
+    int _capacity;
+    int _size;
+    vector<Node> _nodes;
+    vector<uint32_t> _slots;
+    size_t _mask;
+    Hash _hash;
+    Policy _policy;
+};
+
+// Evicts the least recently used entry: a recency list threaded through the slab
+// indices, least recently used first.
+class LRUPolicy {
+public:
+    void init(int capacity) {
+        _links.resize(capacity);
+        _head = NIL;
+        _tail = NIL;
+    }
+
+    void onInsert(uint32_t idx) {
+        _pushBack(idx);
+    }
+
+    void onHit(uint32_t idx) {
+        if (idx != _tail) {
+            _unlink(idx);
+            _pushBack(idx);
+        }
+    }
+
+    uint32_t evict() {
+        uint32_t idx = _head;
+        _unlink(idx);
+        return idx;
+    }
+
+private:
+    struct Link {
+        uint32_t prev;
+        uint32_t next;
+    };
+
+    void _unlink(uint32_t idx) {
+        Link& l = _links[idx];
+        if (l.prev != NIL) {
+            _links[l.prev].next = l.next;
+        } else {
+            _head = l.next;
+        }
+        if (l.next != NIL) {
+            _links[l.next].prev = l.prev;
+        } else {
+            _tail = l.prev;
+        }
+    }
+
+    void _pushBack(uint32_t idx) {
+        Link& l = _links[idx];
+        l.prev = _tail;
+        l.next = NIL;
+        if (_tail != NIL) {
+            _links[_tail].next = idx;
+        } else {
+            _head = idx;
+        }
+        _tail = idx;
+    }
+
+    vector<Link> _links;
+    uint32_t _head;
+    uint32_t _tail;
+};
+
+// Evicts the oldest entry, whatever its hits. The slab is filled in order and
+// every evicted slot is refilled by the newest entry, so the slots are always in
+// insertion order around a ring: the victim is just the next slot of the ring.
+class FIFOPolicy {
+public:
+    void init(int capacity) {
+        _capacity = capacity;
+        _next = 0;
+    }
+
+    void onInsert(uint32_t) {}
+
+    void onHit(uint32_t) {}
+
+    uint32_t evict() {
+        uint32_t idx = _next;
+        _next = _next + 1 == static_cast<uint32_t>(_capacity) ? 0 : _next + 1;
+        return idx;
+    }
+
+private:
+    int _capacity;
+    uint32_t _next;
+};
+
+// CLOCK (second chance), as in p146v8_lru_cache_clock.cpp: a hit only sets the
+// reference bit of the entry, and the hand evicts the first entry whose bit is
+// clear, clearing the bits it passes.
+class CLOCKPolicy {
+public:
+    void init(int capacity) {
+        _capacity = capacity;
+        _referenced.assign(capacity, 0);
+        _hand = 0;
+    }
+
+    void onInsert(uint32_t idx) {
+        _referenced[idx] = 0;
+    }
+
+    void onHit(uint32_t idx) {
+        _referenced[idx] = 1;
+    }
+
+    uint32_t evict() {
+        while (_referenced[_hand] != 0) {
+            _referenced[_hand] = 0;
+            _advance();
+        }
+        uint32_t idx = _hand;
+        _advance();
+        return idx;
+    }
+
+private:
+    void _advance() {
+        _hand = _hand + 1 == static_cast<uint32_t>(_capacity) ? 0 : _hand + 1;
+    }
+
+    int _capacity;
+    vector<uint8_t> _referenced;
+    uint32_t _hand;
+};
+
+// Evicts the least frequently used entry, and among those the least recently
+// used one (the policy of p460_LFUCache.cpp). Same buckets as the O(1) LFUCache
+// of p460v3_LFUCache_buckets.cpp, but with no hash map of buckets: the non-empty
+// buckets form a list sorted by hit count, so the next bucket of an entry is
+// either the neighbour of its bucket or a new one inserted right after it.
+// Buckets come from a pool sized in init: there are at most capacity non-empty
+// buckets, plus the one created by a hit before the old one empties.
+class LFUPolicy {
+public:
+    void init(int capacity) {
+        _items.resize(capacity);
+        _buckets.resize(capacity + 1);
+        for (size_t b = 0; b < _buckets.size(); ++b) {
+            _buckets[b].next = b + 1 < _buckets.size() ? b + 1 : NIL;
+        }
+        _freeBuckets = 0;
+        _first = NIL;
+    }
+
+    void onInsert(uint32_t idx) {
+        // A new entry has the lowest possible count.
+        if (_first == NIL || _buckets[_first].numHits != 1) {
+            _first = _newBucket(1, NIL, _first);
+        }
+        _append(_first, idx);
+    }
+
+    void onHit(uint32_t idx) {
+        uint32_t from = _items[idx].bucket;
+        uint32_t numHits = _buckets[from].numHits + 1;
+        uint32_t to = _buckets[from].next;
+        if (to == NIL || _buckets[to].numHits != numHits) {
+            to = _newBucket(numHits, from, to);
+        }
+        _remove(from, idx);
+        _append(to, idx);
+    }
+
+    uint32_t evict() {
+        uint32_t idx = _buckets[_first].head;
+        _remove(_first, idx);
+        return idx;
+    }
+
+private:
+    struct Item {
+        uint32_t bucket;
+        uint32_t prev;
+        uint32_t next;
+    };
+
+    struct Bucket {
+        uint32_t numHits;
+        // Entries with this count, least recently used first.
+        uint32_t head;
+        uint32_t tail;
+        // Neighbouring buckets (lower and higher counts). In the pool, next links
+        // the free buckets.
+        uint32_t prev;
+        uint32_t next;
+    };
+
+    uint32_t _newBucket(uint32_t numHits, uint32_t prev, uint32_t next) {
+        uint32_t b = _freeBuckets;
+        _freeBuckets = _buckets[b].next;
+        _buckets[b] = Bucket{numHits, NIL, NIL, prev, next};
+        if (prev != NIL) {
+            _buckets[prev].next = b;
+        }
+        if (next != NIL) {
+            _buckets[next].prev = b;
+        }
+        return b;
+    }
+
+    void _append(uint32_t b, uint32_t idx) {
+        Bucket& bucket = _buckets[b];
+        _items[idx] = Item{b, bucket.tail, NIL};
+        if (bucket.tail != NIL) {
+            _items[bucket.tail].next = idx;
+        } else {
+            bucket.head = idx;
+        }
+        bucket.tail = idx;
+    }
+
+    // Takes the entry out of its bucket, and the bucket back to the pool if it is
+    // left empty.
+    void _remove(uint32_t b, uint32_t idx) {
+        Bucket& bucket = _buckets[b];
+        Item& item = _items[idx];
+        if (item.prev != NIL) {
+            _items[item.prev].next = item.next;
+        } else {
+            bucket.head = item.next;
+        }
+        if (item.next != NIL) {
+            _items[item.next].prev = item.prev;
+        } else {
+            bucket.tail = item.prev;
+        }
+
+        if (bucket.head == NIL) {
+            if (bucket.prev != NIL) {
+                _buckets[bucket.prev].next = bucket.next;
+            } else {
+                _first = bucket.next;
+            }
+            if (bucket.next != NIL) {
+                _buckets[bucket.next].prev = bucket.prev;
+            }
+            bucket.next = _freeBuckets;
+            _freeBuckets = b;
+        }
+    }
+
+    vector<Item> _items;
+    vector<Bucket> _buckets;
+    uint32_t _freeBuckets;
+
+    // Bucket with the lowest count: its head is the next victim.
+    uint32_t _first;
+};
+
+// Handwritten slab LRU cache of p146v4_lru_cache_slab.cpp (recency links inside
+// the nodes), to measure what the policy hooks cost.
+class SlabLRUCache {
+public:
+    SlabLRUCache(int capacity) : _capacity(capacity), _size(0), _head(NIL), _tail(NIL) {
+        _nodes.resize(capacity);
+        size_t numSlots = 1;
+        while (numSlots < 2 * static_cast<size_t>(capacity)) {
+            numSlots <<= 1;
+        }
+        _slots.assign(numSlots, NIL);
+        _mask = numSlots - 1;
+    }
+
+    bool get(int const & key, int& value) {
+        uint32_t idx = _slots[_findSlot(key)];
+        if (idx == NIL) {
+            return false;
+        }
+        _reEnqueue(idx);
+        value = _nodes[idx].value;
+        return true;
+    }
+
+    void put(int const & key, int const & value) {
+        if (_capacity == 0) {
+            return;
+        }
+        uint32_t slot = _findSlot(key);
+        uint32_t idx = _slots[slot];
+        if (idx != NIL) {
+            _nodes[idx].value = value;
+            _reEnqueue(idx);
+            return;
+        }
+        if (_size == _capacity) {
+            idx = _head;
+            _unlink(idx);
+            _eraseSlot(_findSlot(_nodes[idx].key));
+            slot = _findSlot(key);
+        } else {
+            idx = _size++;
+        }
+        _nodes[idx].key = key;
+        _nodes[idx].value = value;
+        _pushBack(idx);
+        _slots[slot] = idx;
+    }
+
+private:
+    struct Node {
+        int key;
+        int value;
+        uint32_t prev;
+        uint32_t next;
+    };
+
+    size_t _home(int key) const {
+        uint64_t h = static_cast<uint64_t>(hash<int>()(key)) * 0x9E3779B97F4A7C15ull;
+        return static_cast<size_t>(h >> 32) & _mask;
+    }
+
+    uint32_t _findSlot(int key) const {
+        size_t slot = _home(key);
+        while (_slots[slot] != NIL && _nodes[_slots[slot]].key != key) {
+            slot = (slot + 1) & _mask;
+        }
+        return static_cast<uint32_t>(slot);
+    }
+
+    void _eraseSlot(size_t hole) {
+        size_t slot = hole;
+        while (true) {
+            slot = (slot + 1) & _mask;
+            uint32_t idx = _slots[slot];
+            if (idx == NIL) {
+                break;
+            }
+            size_t home = _home(_nodes[idx].key);
+            if (((slot - home) & _mask) >= ((slot - hole) & _mask)) {
+                _slots[hole] = idx;
+                hole = slot;
+            }
+        }
+        _slots[hole] = NIL;
+    }
+
+    void _unlink(uint32_t idx) {
+        Node& n = _nodes[idx];
+        if (n.prev != NIL) {
+            _nodes[n.prev].next = n.next;
+        } else {
+            _head = n.next;
+        }
+        if (n.next != NIL) {
+            _nodes[n.next].prev = n.prev;
+        } else {
+            _tail = n.prev;
+        }
+    }
+
+    void _pushBack(uint32_t idx) {
+        Node& n = _nodes[idx];
+        n.prev = _tail;
+        n.next = NIL;
+        if (_tail != NIL) {
+            _nodes[_tail].next = idx;
+        } else {
+            _head = idx;
+        }
+        _tail = idx;
+    }
+
+    void _reEnqueue(uint32_t idx) {
+        if (idx != _tail) {
+            _unlink(idx);
+            _pushBack(idx);
+        }
+    }
+
+    int _capacity;
+    int _size;
+    uint32_t _head;
+    uint32_t _tail;
+    vector<Node> _nodes;
+    vector<uint32_t> _slots;
+    size_t _mask;
+};
+
+// Handwritten O(1) LFUCache of p460v3_LFUCache_buckets.cpp, with the get of the
+// template.
+class BucketLFUCache {
+public:
+    BucketLFUCache(int capacity) : _capacity(capacity), _minHits(0) {
+        _cache.reserve(capacity);
+    }
+
+    bool get(int const & key, int& value) {
+        unordered_map<int, list<Entry>::iterator>::iterator mIt = _cache.find(key);
+        if (mIt == _cache.end()) {
+            return false;
+        }
+        _touch(mIt->second);
+        value = mIt->second->value;
+        return true;
+    }
+
+    void put(int const & key, int const & value) {
+        if (_capacity <= 0) {
+            return;
+        }
+        unordered_map<int, list<Entry>::iterator>::iterator mIt = _cache.find(key);
+        if (mIt != _cache.end()) {
+            mIt->second->value = value;
+            _touch(mIt->second);
+            return;
+        }
+        if (_cache.size() == _capacity) {
+            list<Entry>& bucket = _buckets[_minHits];
+            _cache.erase(bucket.front().key);
+            bucket.pop_front();
+            if (bucket.empty()) {
+                _buckets.erase(_minHits);
+            }
+        }
+        list<Entry>& bucket = _buckets[1];
+        bucket.push_back(Entry{key, value, 1});
+        _cache[key] = prev(bucket.end());
+        _minHits = 1;
+    }
+
+private:
+    struct Entry {
+        int key;
+        int value;
+        int numHits;
+    };
+
+    void _touch(list<Entry>::iterator it) {
+        int hits = it->numHits;
+        list<Entry>& from = _buckets[hits];
+        list<Entry>& to = _buckets[hits + 1];
+        to.splice(to.end(), from, it);
+        it->numHits++;
+        if (from.empty()) {
+            _buckets.erase(hits);
+            if (_minHits == hits) {
+                _minHits = hits + 1;
+            }
+        }
+    }
+
+    int _capacity;
+    int _minHits;
+    unordered_map<int, list<Entry>> _buckets;
+    unordered_map<int, list<Entry>::iterator> _cache;
+};
+
+struct XorShift {
+    uint64_t s;
+    XorShift(uint64_t seed) : s(seed) {}
+    uint64_t next() {
+        s ^= s << 13;
+        s ^= s >> 7;
+        s ^= s << 17;
+        return s;
+    }
+};
+
+// Random operations on two caches with the same policy: every get must agree.
+template <typename Cache, typename Reference>
+void checkAgainstReference(int capacity, int numKeys, int numOps) {
+    Cache cache(capacity);
+    Reference reference(capacity);
+    XorShift rng(capacity * 31 + numKeys);
+    for (int i = 0; i < numOps; ++i) {
+        uint64_t r = rng.next();
+        int key = (r >> 8) % numKeys;
+        if (r & 1) {
+            int value = -1;
+            int expected = -1;
+            bool found = cache.get(key, value);
+            assert(found == reference.get(key, expected));
+            assert(value == expected);
+        } else {
+            cache.put(key, i);
+            reference.put(key, i);
+        }
+    }
+}
+
+vector<int> zipfTrace(int numKeys, double theta, int length, uint64_t seed) {
+    vector<double> cdf(numKeys);
+    double sum = 0.0;
+    for (int k = 0; k < numKeys; ++k) {
+        sum += 1.0 / pow(k + 1, theta);
+        cdf[k] = sum;
+    }
+    XorShift rng(seed);
+    vector<int> trace(length);
+    for (int& key : trace) {
+        double u = (rng.next() >> 11) * (1.0 / 9007199254740992.0) * sum;
+        key = lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+    }
+    return trace;
+}
+
+// Zipfian accesses interrupted by one-off sequential scans over cold keys.
+vector<int> zipfWithScansTrace(int numKeys, int length) {
+    vector<int> trace = zipfTrace(numKeys, 0.99, length, 7);
+    int scanKey = numKeys;
+    for (int i = 0; i + 20000 <= length; i += 100000) {
+        for (int j = i; j < i + 20000; ++j) {
+            trace[j] = scanKey++;
+        }
+    }
+    return trace;
+}
+
+// A loop over slightly more keys than fit in the cache: the worst case of LRU.
+vector<int> loopTrace(int numKeys, int length) {
+    vector<int> trace(length);
+    for (int i = 0; i < length; ++i) {
+        trace[i] = i % numKeys;
+    }
+    return trace;
+}
+
+vector<int> uniformTrace(int numKeys, int length) {
+    XorShift rng(3);
+    vector<int> trace(length);
+    for (int& key : trace) {
+        key = rng.next() % numKeys;
+    }
+    return trace;
+}
+
+// Sum of all the values read, printed at the end so that the compiler cannot
+// drop the benchmark loops.
+static long long checksum = 0;
+
+// Replays a trace as a read-through cache (get, and put on a miss). Prints the
+// hit ratio and ns/op as one cell of the matrix.
+template <typename Cache>
+void benchmark(vector<int> const & trace, int capacity) {
+    Cache cache(capacity);
+    long long hits = 0;
+    auto start = chrono::steady_clock::now();
+    for (int key : trace) {
+        int value;
+        if (cache.get(key, value)) {
+            ++hits;
+            checksum += value;
+        } else {
+            cache.put(key, key);
+        }
+    }
+    auto end = chrono::steady_clock::now();
+    cout << fixed << setprecision(1) << setw(7) << 100.0 * hits / trace.size() << "% "
+         << setw(6) << chrono::duration<double, nano>(end - start).count() / trace.size() << "ns";
+}
+
+int main() {
+    int capacity = 2;
+    Cache<int, int, LFUPolicy>* cache = new Cache<int, int, LFUPolicy>(capacity);
+    int value;
+
+    cout << "cache->put(1, 1)" << endl;
+    cache->put(1, 1);
+    cout << "cache->put(2, 2)" << endl;
+    cache->put(2, 2);
+    cout << "cache->get(1): " << (cache->get(1, value) ? value : -1) << endl;
+    cout << "cache->put(3, 3)" << endl;
+    cache->put(3, 3);
+    cout << "cache->get(2): " << (cache->get(2, value) ? value : -1) << endl;
+    cout << "cache->get(3): " << (cache->get(3, value) ? value : -1) << endl;
+    cout << "cache->put(4, 4)" << endl;
+    cache->put(4, 4);
+    cout << "cache->get(1): " << (cache->get(1, value) ? value : -1) << endl;
+    cout << "cache->get(3): " << (cache->get(3, value) ? value : -1) << endl;
+    cout << "cache->get(4): " << (cache->get(4, value) ? value : -1) << endl;
+    assert(!cache->get(1, value) && cache->get(3, value) && cache->get(4, value));
+    delete cache;
+    cout << endl;
+
+    for (int c : {0, 1, 10, 1000}) {
+        checkAgainstReference<Cache<int, int, LRUPolicy>, SlabLRUCache>(c, 3 * c + 1, 200000);
+        checkAgainstReference<Cache<int, int, LFUPolicy>, BucketLFUCache>(c, 3 * c + 1, 200000);
+    }
+    cout << "LRU and LFU policies agree with the handwritten caches." << endl;
+
+    Cache<int, int, FIFOPolicy> fifo(2);
+    fifo.put(1, 1);
+    fifo.put(2, 2);
+    fifo.get(1, value);
+    fifo.put(3, 3);
+    // 1 is the oldest entry: the hit does not save it.
+    assert(!fifo.get(1, value) && fifo.get(2, value) && fifo.get(3, value));
+
+    Cache<string, int, CLOCKPolicy> clock(2);
+    clock.put("a", 1);
+    clock.put("b", 2);
+    clock.get("a", value);
+    clock.put("c", 3);
+    // "a" had a second chance.
+    assert(clock.get("a", value) && !clock.get("b", value) && clock.get("c", value));
+    cout << "FIFO and CLOCK checks passed." << endl << endl;
+
+    int numKeys = 1000000;
+    int benchCapacity = 100000;
+    int length = 5000000;
+    vector<pair<string, vector<int>>> workloads;
+    workloads.emplace_back("Zipf 0.99      ", zipfTrace(numKeys, 0.99, length, 1));
+    workloads.emplace_back("Zipf 0.99+scans", zipfWithScansTrace(numKeys, length));
+    workloads.emplace_back("Loop 110K      ", loopTrace(110000, length));
+    workloads.emplace_back("Uniform 200K   ", uniformTrace(200000, length));
+
+    cout << "Benchmark (read-through, capacity " << benchCapacity << "): hit ratio and ns/op" << endl;
+    cout << "workload         LRU             FIFO            CLOCK           LFU"
+         << "              | LRU (handwritten) LFU (handwritten)" << endl;
+    for (pair<string, vector<int>> const & w : workloads) {
+        cout << w.first;
+        benchmark<Cache<int, int, LRUPolicy>>(w.second, benchCapacity);
+        benchmark<Cache<int, int, FIFOPolicy>>(w.second, benchCapacity);
+        benchmark<Cache<int, int, CLOCKPolicy>>(w.second, benchCapacity);
+        benchmark<Cache<int, int, LFUPolicy>>(w.second, benchCapacity);
+        cout << "  |";
+        benchmark<SlabLRUCache>(w.second, benchCapacity);
+        benchmark<BucketLFUCache>(w.second, benchCapacity);
+        cout << endl;
+    }
+    cout << "(checksum " << checksum << ")" << endl;
+    return 0;
+}
@@ -0,0 +1,550 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "trace_io.h"
+
+using namespace std;
+
+// Replays a LeetCode-style cache trace natively, instead of generating C++ with
+// format_input.py and recompiling:
+//
+//   replay_trace [--cache=LRU|LFU] <trace> [<expected>]
+//   replay_trace [--cache=LRU|LFU] [--capacity=N] <trace.bin>
+//
+// <trace> holds the two input rows of the problem:
+//   ["LFUCache","put","put","get",...]
+//   [[2],[1,1],[2,2],[1],...]
+// <expected>, if given, holds the output row ([null,null,null,1,...]) and every
+// get is checked against it.
+//
+// <trace.bin> is a binary trace written by trace_convert (recognized by its
+// magic). It is memory-mapped and its fixed-width records go straight to the
+// cache, with no parsing at all. Its gets are checked if it was converted with
+// the expected outputs. The capacity comes from the header unless --capacity
+// is given, and the cache defaults to LRU.
+//
+// The rows are streamed, never loaded in memory, so traces of 100M+ operations
+// are fine. Prints the latency percentiles, the hit ratio and the memory usage.
+
+// O(1) LRU cache of p146v2_lru_cache.cpp.
+class LRUCache {
+public:
+    LRUCache(int capacity) : _capacity(capacity) {}
+
+    void put(int key, int value) {
+        if (_capacity <= 0) {
+            return;
+        }
+
+        unordered_map<int, list<pair<int, int>>::iterator>::iterator it = _m.find(key);
+        if (it != _m.end()) {
+            it->second->second = value;
+            _q.splice(_q.end(), _q, it->second);
+            return;
+        }
+
+        if (_m.size() == _capacity) {
+            list<pair<int, int>>::iterator lru = _q.begin();
+            _m.erase(lru->first);
+            lru->first = key;
+            lru->second = value;
+            _q.splice(_q.end(), _q, lru);
+            _m[key] = lru;
+        } else {
+            _q.emplace_back(key, value);
+            _m[key] = prev(_q.end());
+        }
+    }
+
+    int get(int key) {
+        unordered_map<int, list<pair<int, int>>::iterator>::iterator it = _m.find(key);
+        if (it == _m.end()) {
+            return -1;
+        }
+
+        _q.splice(_q.end(), _q, it->second);
+        return it->second->second;
+    }
+
+private:
+    int _capacity;
+    list<pair<int, int>> _q;
+    unordered_map<int, list<pair<int, int>>::iterator> _m;
+};
+
+// LFUCache of p460_LFUCache.cpp.
+struct Entry {
+    int key;
+    int value;
+    int numHits;
+    int lastHit;
+
+    bool operator<(Entry const & rhs) const {
+        if (numHits < rhs.numHits) {
+            return true;
+        } else if (numHits > rhs.numHits) {
+            return false;
+        } else {
+            return lastHit < rhs.lastHit;
+        }
+    }
+};
+
+typedef list<Entry>::iterator entryIt;
+
+class LFUCache {
+public:
+    LFUCache(int capacity) : _capacity(capacity), _count(0) {}
+    int get(int key);
+    void put(int key, int value);
+
+private:
+    void _update(entryIt& it);
+
+    int _capacity;
+    int _count;
+    list<Entry> _l;
+    unordered_map<int, entryIt> _cache;
+};
+
+void LFUCache::_update(entryIt& it) {
+    Entry entry(*it);
+    entryIt nextIt = _l.erase(it);
+    for (; nextIt != _l.end() && *nextIt < entry; ++nextIt) {}
+    it = _l.insert(nextIt, entry);
+}
+
+int LFUCache::get(int key) {
+    ++_count;
+    unordered_map<int, entryIt>::iterator mIt = _cache.find(key);
+    if (mIt == _cache.end()) {
+        return -1;
+    }
+
+    entryIt& lIt = mIt->second;
+    lIt->numHits++;
+    lIt->lastHit = _count;
+    _update(lIt);
+    return lIt->value;
+}
+
+void LFUCache::put(int key, int value) {
+    ++_count;
+    if (_capacity == 0) {
+        return;
+    }
+
+    unordered_map<int, entryIt>::iterator mIt = _cache.find(key);
+    if (mIt != _cache.end()) {
+        entryIt& lIt = mIt->second;
+        lIt->value = value;
+        lIt->numHits++;
+        lIt->lastHit = _count;
+        _update(lIt);
+    } else {
+        if (_cache.size() == _capacity && _capacity > 0) {
+            int lfuKey = _l.front().key;
+            _cache.erase(lfuKey);
+            _l.pop_front();
+        }
+
+        Entry entry;
+        entry.key = key;
+        entry.value = value;
+        entry.numHits = 1;
+        entry.lastHit = _count;
+        _l.push_front(entry);
+        entryIt lIt = _l.begin();
+        _update(lIt);
+        _cache.insert(pair<int, entryIt>(key, lIt));
+    }
+}
+
+// Latency histogram with about 12% resolution: 8 linear sub-buckets per power of
+// two of nanoseconds.
+class LatencyHistogram {
+public:
+    LatencyHistogram() : _counts(64 * SUB, 0), _total(0) {}
+
+    void add(uint64_t ns) {
+        ++_counts[_bucket(ns)];
+        ++_total;
+    }
+
+    // Upper bound (in ns) of the bucket holding the q-th quantile.
+    uint64_t quantile(double q) const {
+        uint64_t rank = static_cast<uint64_t>(q * (_total - 1));
+        uint64_t seen = 0;
+        for (size_t b = 0; b < _counts.size(); ++b) {
+            seen += _counts[b];
+            if (seen > rank) {
+                return _upperBound(b);
+            }
+        }
+        return 0;
+    }
+
+    uint64_t total() const {
+        return _total;
+    }
+
+private:
+    static const int SUB = 8;
+
+    static size_t _bucket(uint64_t ns) {
+        if (ns < SUB) {
+            return ns;
+        }
+        int log = 63 - __builtin_clzll(ns);
+        size_t sub = (ns >> (log - 3)) & (SUB - 1);
+        return (log - 2) * SUB + sub;
+    }
+
+    static uint64_t _upperBound(size_t bucket) {
+        if (bucket < SUB) {
+            return bucket;
+        }
+        int log = bucket / SUB + 2;
+        uint64_t sub = bucket % SUB;
+        return ((SUB + sub + 1) << (log - 3)) - 1;
+    }
+
+    vector<uint64_t> _counts;
+    uint64_t _total;
+};
+
+// Returns a field of /proc/self/status (e.g. "VmRSS") in kB, or -1.
+long long procStatusKb(string const & field) {
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line)) {
+        if (line.compare(0, field.size() + 1, field + ":") == 0) {
+            return stoll(line.substr(field.size() + 1));
+        }
+    }
+    return -1;
+}
+
+// Read-only mapping of a binary trace. The kernel reads ahead (MADV_SEQUENTIAL),
+// so replaying streams the file at the speed of the page cache or of the disk.
+class BinaryTrace {
+public:
+    BinaryTrace(string const & path) : _data(nullptr), _size(0), _released(0) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw runtime_error("Cannot open " + path);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(TraceHeader))) {
+            close(fd);
+            throw runtime_error(path + " is too short to be a binary trace");
+        }
+        _size = st.st_size;
+        void* data = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (data == MAP_FAILED) {
+            throw runtime_error("Cannot map " + path);
+        }
+        _data = static_cast<char const *>(data);
+        madvise(data, _size, MADV_SEQUENTIAL);
+
+        // The destructor does not run if the constructor throws: unmap here.
+        string error;
+        if (memcmp(header().magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0) {
+            error = path + " is not a binary trace";
+        } else if (header().numRecords != (_size - sizeof(TraceHeader)) / sizeof(TraceRecord)
+                   || (_size - sizeof(TraceHeader)) % sizeof(TraceRecord) != 0) {
+            // Compared by division: numRecords * 16 could overflow.
+            error = path + ": the size does not match the number of records";
+        }
+        if (!error.empty()) {
+            munmap(data, _size);
+            _data = nullptr;
+            throw runtime_error(error);
+        }
+    }
+
+    ~BinaryTrace() {
+        if (_data != nullptr) {
+            munmap(const_cast<char*>(_data), _size);
+        }
+    }
+
+    BinaryTrace(BinaryTrace const &) = delete;
+    BinaryTrace& operator=(BinaryTrace const &) = delete;
+
+    // True if the file starts with the magic of a binary trace.
+    static bool isBinary(string const & path) {
+        char magic[sizeof(TRACE_MAGIC)];
+        ifstream in(path, ios::binary);
+        return in.read(magic, sizeof(magic)) && memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0;
+    }
+
+    TraceHeader const & header() const {
+        return *reinterpret_cast<TraceHeader const *>(_data);
+    }
+
+    TraceRecord const * begin() const {
+        return reinterpret_cast<TraceRecord const *>(_data + sizeof(TraceHeader));
+    }
+
+    TraceRecord const * end() const {
+        return begin() + header().numRecords;
+    }
+
+    // Drops the pages before the record from the mapping: they will not be read
+    // again, and would otherwise count in the RSS of a multi-gigabyte replay.
+    void release(TraceRecord const * upTo) const {
+        size_t page = sysconf(_SC_PAGESIZE);
+        size_t bytes = (reinterpret_cast<char const *>(upTo) - _data) / page * page;
+        if (bytes > _released) {
+            madvise(const_cast<char*>(_data) + _released, bytes - _released, MADV_DONTNEED);
+            _released = bytes;
+        }
+    }
+
+private:
+    char const * _data;
+    size_t _size;
+
+    // Bytes at the start of the mapping already dropped by release.
+    mutable size_t _released;
+};
+
+struct ReplayResult {
+    LatencyHistogram latencies;
+    long long gets = 0;
+    long long hits = 0;
+    long long mismatches = 0;
+};
+
+template <typename Cache>
+void replay(int capacity, RowReader& ops, RowReader& args, RowReader* expected, ReplayResult& result) {
+    Cache cache(capacity);
+    string op;
+    string arg;
+    string want;
+    vector<int> a;
+    long long i = 0;
+    while (ops.next(op)) {
+        ++i;
+        if (!args.next(arg)) {
+            throw runtime_error("Fewer argument lists than operations");
+        }
+        if (expected != nullptr && !expected->next(want)) {
+            throw runtime_error("Fewer expected outputs than operations");
+        }
+        RowReader::parseArgs(arg, a);
+
+        if (op == "get") {
+            if (a.size() != 1) {
+                throw runtime_error("get expects 1 argument at operation " + to_string(i));
+            }
+            auto start = chrono::steady_clock::now();
+            int value = cache.get(a[0]);
+            auto end = chrono::steady_clock::now();
+            result.latencies.add(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+            ++result.gets;
+            if (value != -1) {
+                ++result.hits;
+            }
+            if (expected != nullptr && want != to_string(value)) {
+                if (result.mismatches++ < 10) {
+                    cout << "mismatch at operation " << i << ": get(" << a[0] << ") = " << value
+                         << ", expected " << want << endl;
+                }
+            }
+        } else if (op == "put") {
+            if (a.size() != 2) {
+                throw runtime_error("put expects 2 arguments at operation " + to_string(i));
+            }
+            auto start = chrono::steady_clock::now();
+            cache.put(a[0], a[1]);
+            auto end = chrono::steady_clock::now();
+            result.latencies.add(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+        } else {
+            throw runtime_error("Unknown operation '" + op + "' at operation " + to_string(i));
+        }
+    }
+}
+
+// Keys wider than int are truncated to their low 32 bits.
+template <typename Cache>
+void replayBinary(int capacity, BinaryTrace const & trace, ReplayResult& result) {
+    Cache cache(capacity);
+    bool check = (trace.header().flags & FLAG_HAS_EXPECTED) != 0;
+    long long i = 0;
+    for (TraceRecord const * r = trace.begin(); r != trace.end(); ++r) {
+        if ((++i & 0xFFFFF) == 0) {
+            trace.release(r);
+        }
+        int key = static_cast<int>(r->key);
+        auto start = chrono::steady_clock::now();
+        if (r->op == OP_GET) {
+            int value = cache.get(key);
+            auto end = chrono::steady_clock::now();
+            result.latencies.add(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+            ++result.gets;
+            if (value != -1) {
+                ++result.hits;
+            }
+            if (check && value != r->value) {
+                if (result.mismatches++ < 10) {
+                    cout << "mismatch at operation " << i << ": get(" << key << ") = " << value
+                         << ", expected " << r->value << endl;
+                }
+            }
+        } else if (r->op == OP_PUT) {
+            cache.put(key, r->value);
+            auto end = chrono::steady_clock::now();
+            result.latencies.add(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+        } else if (r->op == OP_ACCESS) {
+            // Read-through: get, and put on a miss.
+            ++result.gets;
+            if (cache.get(key) != -1) {
+                ++result.hits;
+            } else {
+                cache.put(key, key);
+            }
+            auto end = chrono::steady_clock::now();
+            result.latencies.add(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+        } else {
+            throw runtime_error("Unknown operation " + to_string(r->op) + " at record " + to_string(i));
+        }
+    }
+}
+
+void printResult(string const & name, double seconds, string const & what, ReplayResult const & result) {
+    long long numOps = result.latencies.total();
+    cout << name << ": " << numOps << " operations in " << seconds << " s (" << what << ")" << endl;
+    cout << "ns/op: p50 " << result.latencies.quantile(0.5)
+         << ", p90 " << result.latencies.quantile(0.9)
+         << ", p99 " << result.latencies.quantile(0.99)
+         << ", p99.9 " << result.latencies.quantile(0.999)
+         << ", max " << result.latencies.quantile(1.0) << endl;
+    cout << "hit ratio: " << (result.gets == 0 ? 0.0 : 100.0 * result.hits / result.gets)
+         << "% (" << result.hits << "/" << result.gets << " gets)" << endl;
+    cout << "RSS: " << procStatusKb("VmRSS") << " kB, peak " << procStatusKb("VmHWM") << " kB" << endl;
+}
+
+int runBinary(string const & path, string cacheType, long long capacity) {
+    BinaryTrace trace(path);
+    if (capacity <= 0) {
+        capacity = trace.header().capacity;
+    }
+    if (capacity <= 0 || capacity > numeric_limits<int>::max()) {
+        throw runtime_error("No valid capacity in the trace header: use --capacity");
+    }
+    if (cacheType.empty()) {
+        cacheType = "LRU";
+    }
+
+    ReplayResult result;
+    auto start = chrono::steady_clock::now();
+    if (cacheType == "LRU") {
+        replayBinary<LRUCache>(capacity, trace, result);
+    } else if (cacheType == "LFU") {
+        replayBinary<LFUCache>(capacity, trace, result);
+    } else {
+        throw runtime_error("Unknown cache type '" + cacheType + "'");
+    }
+    auto end = chrono::steady_clock::now();
+
+    printResult(cacheType + "Cache(" + to_string(capacity) + ")",
+                chrono::duration<double>(end - start).count(), "binary, mmap", result);
+    if (trace.header().flags & FLAG_HAS_EXPECTED) {
+        cout << "check: " << (result.mismatches == 0 ? "OK" : to_string(result.mismatches) + " mismatches") << endl;
+    }
+    return result.mismatches == 0 ? 0 : 1;
+}
+
+int main(int argc, char** argv) {
+    string cacheType;
+    long long capacity = 0;
+    vector<string> paths;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg.compare(0, 8, "--cache=") == 0) {
+            cacheType = arg.substr(8);
+        } else if (arg.compare(0, 11, "--capacity=") == 0) {
+            capacity = stoll(arg.substr(11));
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty() || paths.size() > 2) {
+        cerr << "Usage: " << argv[0] << " [--cache=LRU|LFU] <trace> [<expected>]" << endl;
+        cerr << "       " << argv[0] << " [--cache=LRU|LFU] [--capacity=N] <trace.bin>" << endl;
+        return 2;
+    }
+
+    try {
+        if (BinaryTrace::isBinary(paths[0])) {
+            if (paths.size() != 1) {
+                throw runtime_error("The expected outputs of a binary trace are in the trace itself");
+            }
+            return runBinary(paths[0], cacheType, capacity);
+        }
+
+        RowReader ops(paths[0], 0);
+        RowReader args(paths[0], 1);
+        unique_ptr<RowReader> expected(paths.size() == 2 ? new RowReader(paths[1], 0) : nullptr);
+
+        // The first operation is the constructor.
+        string ctor;
+        string ctorArgs;
+        string ctorOutput;
+        vector<int> a;
+        if (!ops.next(ctor) || !args.next(ctorArgs)) {
+            throw runtime_error("Empty trace");
+        }
+        if (expected != nullptr) {
+            expected->next(ctorOutput);
+        }
+        RowReader::parseArgs(ctorArgs, a);
+        if (a.size() != 1) {
+            throw runtime_error("The constructor expects 1 argument");
+        }
+        if (cacheType.empty()) {
+            cacheType = ctor.substr(0, 3);
+        }
+
+        ReplayResult result;
+        auto start = chrono::steady_clock::now();
+        if (cacheType == "LRU") {
+            replay<LRUCache>(a[0], ops, args, expected.get(), result);
+        } else if (cacheType == "LFU") {
+            replay<LFUCache>(a[0], ops, args, expected.get(), result);
+        } else {
+            throw runtime_error("Unknown cache type '" + cacheType + "'");
+        }
+        auto end = chrono::steady_clock::now();
+
+        printResult(cacheType + "Cache(" + to_string(a[0]) + ")",
+                    chrono::duration<double>(end - start).count(), "including parsing", result);
+        if (paths.size() == 2) {
+            cout << "check: " << (result.mismatches == 0 ? "OK" : to_string(result.mismatches) + " mismatches") << endl;
+        }
+        return result.mismatches == 0 ? 0 : 1;
+    } catch (exception const & e) {
+        cerr << "Error: " << e.what() << endl;
+        return 2;
+    }
+}
@@ -0,0 +1,358 @@
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// O(1) LRUCache of p146v2_lru_cache.cpp.
+class LRUCache {
+public:
+    LRUCache(int capacity) : _capacity(capacity) {
+        _m.reserve(capacity);
+    }
+
+    int get(int key) {
+        unordered_map<int, list<pair<int, int>>::iterator>::iterator it = _m.find(key);
+        if (it == _m.end()) {
+            return -1;
+        }
+        _q.splice(_q.end(), _q, it->second);
+        return it->second->second;
+    }
+
+    void put(int key, int value) {
+        if (_capacity <= 0) {
+            return;
+        }
+        unordered_map<int, list<pair<int, int>>::iterator>::iterator it = _m.find(key);
+        if (it != _m.end()) {
+            it->second->second = value;
+            _q.splice(_q.end(), _q, it->second);
+            return;
+        }
+        if (_m.size() == _capacity) {
+            list<pair<int, int>>::iterator lru = _q.begin();
+            _m.erase(lru->first);
+            lru->first = key;
+            lru->second = value;
+            _q.splice(_q.end(), _q, lru);
+            _m[key] = lru;
+            return;
+        }
+        _q.emplace_back(key, value);
+        _m[key] = prev(_q.end());
+    }
+
+private:
+    int _capacity;
+    list<pair<int, int>> _q;
+    unordered_map<int, list<pair<int, int>>::iterator> _m;
+};
+
+// O(1) LFUCache of p460v3_LFUCache_buckets.cpp.
+class LFUCache {
+public:
+    LFUCache(int capacity) : _capacity(capacity), _minHits(0) {
+        _cache.reserve(capacity);
+    }
+
+    int get(int key) {
+        unordered_map<int, list<Entry>::iterator>::iterator mIt = _cache.find(key);
+        if (mIt == _cache.end()) {
+            return -1;
+        }
+        _touch(mIt->second);
+        return mIt->second->value;
+    }
+
+    void put(int key, int value) {
+        if (_capacity <= 0) {
+            return;
+        }
+        unordered_map<int, list<Entry>::iterator>::iterator mIt = _cache.find(key);
+        if (mIt != _cache.end()) {
+            mIt->second->value = value;
+            _touch(mIt->second);
+            return;
+        }
+        if (_cache.size() == _capacity) {
+            list<Entry>& bucket = _buckets[_minHits];
+            _cache.erase(bucket.front().key);
+            bucket.pop_front();
+            if (bucket.empty()) {
+                _buckets.erase(_minHits);
+            }
+        }
+        list<Entry>& bucket = _buckets[1];
+        bucket.push_back(Entry{key, value, 1});
+        _cache[key] = prev(bucket.end());
+        _minHits = 1;
+    }
+
+private:
+    struct Entry {
+        int key;
+        int value;
+        int numHits;
+    };
+
+    void _touch(list<Entry>::iterator it) {
+        int hits = it->numHits;
+        list<Entry>& from = _buckets[hits];
+        list<Entry>& to = _buckets[hits + 1];
+        to.splice(to.end(), from, it);
+        it->numHits++;
+        if (from.empty()) {
+            _buckets.erase(hits);
+            if (_minHits == hits) {
+                _minHits = hits + 1;
+            }
+        }
+    }
+
+    int _capacity;
+    int _minHits;
+    unordered_map<int, list<Entry>> _buckets;
+    unordered_map<int, list<Entry>::iterator> _cache;
+};
+
+typedef function<int(int)> Loader;
+
+// Thread-safe wrapper of any cache with the get/put interface of LRUCache and
+// LFUCache, adding getOrLoad.
+//
+// On a miss, the first caller (the leader) registers an in-flight load for the
+// key and runs the loader outside the lock. Callers that miss on the same key
+// while the load is in flight do not call their loader: they wait on the
+// leader's shared_future and get its value, or its exception. The leader puts
+// the value in the cache and retires the flight under the same lock, so a new
+// caller always finds either the value or the flight. A failed load is not
+// cached: the next caller after it loads again.
+//
+// -1 is the miss value of the underlying caches, so loaders must not return it.
+template <typename Cache>
+class SingleFlightCache {
+public:
+    SingleFlightCache(int capacity) : _cache(capacity) {}
+
+    int get(int key) {
+        lock_guard<mutex> lock(_mtx);
+        return _cache.get(key);
+    }
+
+    void put(int key, int value) {
+        lock_guard<mutex> lock(_mtx);
+        _cache.put(key, value);
+    }
+
+    int getOrLoad(int key, Loader const & loader) {
+        promise<int> leader;
+        {
+            unique_lock<mutex> lock(_mtx);
+            int value = _cache.get(key);
+            if (value != -1) {
+                return value;
+            }
+
+            unordered_map<int, shared_future<int>>::iterator it = _inFlight.find(key);
+            if (it != _inFlight.end()) {
+                // Someone is already loading the key: wait for their result.
+                shared_future<int> flight = it->second;
+                lock.unlock();
+                return flight.get();
+            }
+            _inFlight.emplace(key, leader.get_future().share());
+        }
+
+        int value;
+        try {
+            value = loader(key);
+        } catch (...) {
+            {
+                lock_guard<mutex> lock(_mtx);
+                _inFlight.erase(key);
+            }
+            leader.set_exception(current_exception());
+            throw;
+        }
+
+        {
+            lock_guard<mutex> lock(_mtx);
+            _cache.put(key, value);
+            _inFlight.erase(key);
+        }
+        leader.set_value(value);
+        return value;
+    }
+
+private:
+    mutex _mtx;
+    Cache _cache;
+
+    // Loads in progress, by key.
+    unordered_map<int, shared_future<int>> _inFlight;
+};
+
+// 64 threads ask for the same keys at the same time, through a slow loader:
+// every key must be loaded exactly once, and every thread must see its value.
+template <typename Cache>
+void checkLoadedOnce(string const & name) {
+    int numThreads = 64;
+    int numKeys = 100;
+    SingleFlightCache<Cache> cache(numKeys);
+    vector<atomic<int>> numLoads(numKeys);
+    for (atomic<int>& n : numLoads) {
+        n = 0;
+    }
+    Loader loader = [&numLoads](int key) {
+        ++numLoads[key];
+        this_thread::sleep_for(chrono::milliseconds(2));
+        return key * 10;
+    };
+
+    atomic<bool> go(false);
+    vector<thread> workers;
+    for (int t = 0; t < numThreads; ++t) {
+        workers.emplace_back([&, t]() {
+            while (!go.load()) {
+                this_thread::yield();
+            }
+            for (int i = 0; i < numKeys; ++i) {
+                // Start at different keys, so that leaders and waiters interleave.
+                int key = (i + t) % numKeys;
+                assert(cache.getOrLoad(key, loader) == key * 10);
+            }
+        });
+    }
+    go = true;
+    for (thread& w : workers) {
+        w.join();
+    }
+    for (int key = 0; key < numKeys; ++key) {
+        assert(numLoads[key] == 1);
+    }
+    cout << name << ": " << numKeys << " keys, " << numThreads << " threads, each key loaded once." << endl;
+}
+
+// All the callers waiting on a failed load get its exception; the next caller
+// loads again.
+void checkFailure() {
+    int numThreads = 64;
+    SingleFlightCache<LRUCache> cache(10);
+    atomic<int> numLoads(0);
+    atomic<int> numFailures(0);
+    Loader failing = [&numLoads](int) -> int {
+        ++numLoads;
+        this_thread::sleep_for(chrono::milliseconds(50));
+        throw runtime_error("backend down");
+    };
+
+    atomic<bool> go(false);
+    vector<thread> workers;
+    for (int t = 0; t < numThreads; ++t) {
+        workers.emplace_back([&]() {
+            while (!go.load()) {
+                this_thread::yield();
+            }
+            try {
+                cache.getOrLoad(7, failing);
+            } catch (runtime_error const & e) {
+                assert(string(e.what()) == "backend down");
+                ++numFailures;
+            }
+        });
+    }
+    go = true;
+    for (thread& w : workers) {
+        w.join();
+    }
+    assert(numFailures == numThreads);
+    // The threads that arrived after the first failure retried: at most a few
+    // loads, not one per thread.
+    assert(numLoads >= 1 && numLoads < numThreads);
+    assert(cache.get(7) == -1);
+
+    assert(cache.getOrLoad(7, [](int key) { return key + 1; }) == 8);
+    assert(cache.get(7) == 8);
+    cout << "Failure: " << numThreads << " callers got the exception from "
+         << numLoads << " load(s); the next caller loaded again." << endl;
+}
+
+int main() {
+    int capacity = 2;
+    SingleFlightCache<LRUCache>* obj = new SingleFlightCache<LRUCache>(capacity);
+    Loader square = [](int key) { return key * key; };
+    cout << "obj->getOrLoad(3, square); " << obj->getOrLoad(3, square) << endl;
+    cout << "obj->put(4, 40);" << endl;
+    obj->put(4, 40);
+    cout << "obj->getOrLoad(4, square); " << obj->getOrLoad(4, square) << endl;
+    cout << "obj->get(3); " << obj->get(3) << endl;
+    assert(obj->get(3) == 9 && obj->get(4) == 40);
+    delete obj;
+    cout << endl;
+
+    checkLoadedOnce<LRUCache>("LRUCache");
+    checkLoadedOnce<LFUCache>("LFUCache");
+    checkFailure();
+    cout << endl;
+
+    // Miss storm: get, then compute and put on a miss, versus getOrLoad.
+    int numThreads = 64;
+    int numKeys = 20;
+    atomic<int> naiveLoads(0);
+    atomic<int> coalescedLoads(0);
+    {
+        SingleFlightCache<LRUCache> cache(numKeys);
+        vector<thread> workers;
+        for (int t = 0; t < numThreads; ++t) {
+            workers.emplace_back([&]() {
+                for (int key = 0; key < numKeys; ++key) {
+                    if (cache.get(key) == -1) {
+                        ++naiveLoads;
+                        this_thread::sleep_for(chrono::milliseconds(5));
+                        cache.put(key, key);
+                    }
+                }
+            });
+        }
+        for (thread& w : workers) {
+            w.join();
+        }
+    }
+    {
+        SingleFlightCache<LRUCache> cache(numKeys);
+        Loader slow = [&coalescedLoads](int key) {
+            ++coalescedLoads;
+            this_thread::sleep_for(chrono::milliseconds(5));
+            return key;
+        };
+        vector<thread> workers;
+        for (int t = 0; t < numThreads; ++t) {
+            workers.emplace_back([&]() {
+                for (int key = 0; key < numKeys; ++key) {
+                    cache.getOrLoad(key, slow);
+                }
+            });
+        }
+        for (thread& w : workers) {
+            w.join();
+        }
+    }
+    cout << "Miss storm (" << numThreads << " threads, " << numKeys << " keys, 5 ms loads):" << endl;
+    cout << "  get + put:  " << naiveLoads << " loads" << endl;
+    cout << "  getOrLoad:  " << coalescedLoads << " loads" << endl;
+    return 0;
+}
@@ -0,0 +1,232 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "trace_io.h"
+
+using namespace std;
+
+// Converts cache traces to the fixed-width binary format replayed by
+// replay_trace, so that replaying never parses text:
+//
+//   trace_convert <trace> [<expected>] <out.bin>
+//   trace_convert --keys [--capacity=N] <key log> <out.bin>
+//
+// The first form reads the LeetCode-style rows of replay_trace (operations,
+// arguments, and optionally the expected outputs, which are stored in the value
+// of the get records). The second reads a raw key log, one integer key per
+// access, and writes one read-through access record per key; the capacity to
+// replay it with can be stored in the header, or given to replay_trace.
+//
+// The binary format is described in trace_io.h.
+
+// Buffered record writer. The header is written first with numRecords = 0, and
+// patched by close().
+class TraceWriter {
+public:
+    TraceWriter(string const & path, int64_t capacity, uint32_t flags) : _path(path) {
+        _file = fopen(path.c_str(), "wb");
+        if (_file == nullptr) {
+            throw runtime_error("Cannot create " + path);
+        }
+        memcpy(_header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        _header.flags = flags;
+        _header.unused = 0;
+        _header.capacity = capacity;
+        _header.numRecords = 0;
+        _write(&_header, sizeof(_header));
+        _buffer.reserve(BUFFER_RECORDS);
+    }
+
+    ~TraceWriter() {
+        if (_file != nullptr) {
+            fclose(_file);
+        }
+    }
+
+    void add(uint8_t op, int64_t key, int32_t value) {
+        TraceRecord r;
+        r.op = op;
+        memset(r.unused, 0, sizeof(r.unused));
+        r.value = value;
+        r.key = key;
+        _buffer.push_back(r);
+        if (_buffer.size() == BUFFER_RECORDS) {
+            _flush();
+        }
+    }
+
+    uint64_t close() {
+        _flush();
+        if (fseek(_file, 0, SEEK_SET) != 0) {
+            throw runtime_error("Cannot seek in " + _path);
+        }
+        _write(&_header, sizeof(_header));
+        if (fclose(_file) != 0) {
+            _file = nullptr;
+            throw runtime_error("Cannot write " + _path);
+        }
+        _file = nullptr;
+        return _header.numRecords;
+    }
+
+private:
+    static const size_t BUFFER_RECORDS = 1 << 16;
+
+    void _flush() {
+        _write(_buffer.data(), _buffer.size() * sizeof(TraceRecord));
+        _header.numRecords += _buffer.size();
+        _buffer.clear();
+    }
+
+    void _write(void const * data, size_t size) {
+        if (size > 0 && fwrite(data, 1, size, _file) != size) {
+            throw runtime_error("Cannot write " + _path);
+        }
+    }
+
+    string _path;
+    FILE* _file;
+    TraceHeader _header;
+    vector<TraceRecord> _buffer;
+};
+
+int32_t checkedValue(long long v, long long i) {
+    if (v < numeric_limits<int32_t>::min() || v > numeric_limits<int32_t>::max()) {
+        throw runtime_error("Value out of the 32-bit range at operation " + to_string(i));
+    }
+    return static_cast<int32_t>(v);
+}
+
+uint64_t convertRows(string const & tracePath, string const & expectedPath, string const & outPath) {
+    RowReader ops(tracePath, 0);
+    RowReader args(tracePath, 1);
+    unique_ptr<RowReader> expected(expectedPath.empty() ? nullptr : new RowReader(expectedPath, 0));
+
+    // The first operation is the constructor.
+    string op;
+    string arg;
+    string want;
+    vector<long long> a;
+    if (!ops.next(op) || !args.next(arg)) {
+        throw runtime_error("Empty trace");
+    }
+    if (expected != nullptr) {
+        expected->next(want);
+    }
+    RowReader::parseArgs(arg, a);
+    if (a.size() != 1) {
+        throw runtime_error("The constructor expects 1 argument");
+    }
+
+    TraceWriter out(outPath, a[0], expected != nullptr ? FLAG_HAS_EXPECTED : 0);
+    long long i = 0;
+    while (ops.next(op)) {
+        ++i;
+        if (!args.next(arg)) {
+            throw runtime_error("Fewer argument lists than operations");
+        }
+        if (expected != nullptr && !expected->next(want)) {
+            throw runtime_error("Fewer expected outputs than operations");
+        }
+        RowReader::parseArgs(arg, a);
+
+        if (op == "get") {
+            if (a.size() != 1) {
+                throw runtime_error("get expects 1 argument at operation " + to_string(i));
+            }
+            int32_t value = expected != nullptr ? checkedValue(strtoll(want.c_str(), nullptr, 10), i) : 0;
+            out.add(OP_GET, a[0], value);
+        } else if (op == "put") {
+            if (a.size() != 2) {
+                throw runtime_error("put expects 2 arguments at operation " + to_string(i));
+            }
+            out.add(OP_PUT, a[0], checkedValue(a[1], i));
+        } else {
+            throw runtime_error("Unknown operation '" + op + "' at operation " + to_string(i));
+        }
+    }
+    return out.close();
+}
+
+uint64_t convertKeys(string const & keyPath, long long capacity, string const & outPath) {
+    FILE* in = fopen(keyPath.c_str(), "rb");
+    if (in == nullptr) {
+        throw runtime_error("Cannot open " + keyPath);
+    }
+    TraceWriter out(outPath, capacity, 0);
+    vector<char> buffer(1 << 20);
+    long long key = 0;
+    bool inKey = false;
+    bool negative = false;
+    size_t len;
+    while ((len = fread(buffer.data(), 1, buffer.size(), in)) > 0) {
+        for (size_t i = 0; i < len; ++i) {
+            char c = buffer[i];
+            if (c >= '0' && c <= '9') {
+                key = key * 10 + (c - '0');
+                inKey = true;
+            } else if (c == '-' && !inKey) {
+                negative = true;
+            } else if (c == ' ' || c == '\n' || c == '\r' || c == '\t') {
+                if (inKey) {
+                    out.add(OP_ACCESS, negative ? -key : key, 0);
+                }
+                key = 0;
+                inKey = false;
+                negative = false;
+            } else {
+                fclose(in);
+                throw runtime_error(string("Unexpected character '") + c + "' in the key log");
+            }
+        }
+    }
+    fclose(in);
+    if (inKey) {
+        out.add(OP_ACCESS, negative ? -key : key, 0);
+    }
+    return out.close();
+}
+
+int main(int argc, char** argv) {
+    bool keys = false;
+    long long capacity = 0;
+    vector<string> paths;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--keys") {
+            keys = true;
+        } else if (arg.compare(0, 11, "--capacity=") == 0) {
+            capacity = stoll(arg.substr(11));
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if ((keys && paths.size() != 2) || (!keys && (paths.size() < 2 || paths.size() > 3))) {
+        cerr << "Usage: " << argv[0] << " <trace> [<expected>] <out.bin>" << endl;
+        cerr << "       " << argv[0] << " --keys [--capacity=N] <key log> <out.bin>" << endl;
+        return 2;
+    }
+
+    try {
+        uint64_t numRecords;
+        if (keys) {
+            numRecords = convertKeys(paths[0], capacity, paths[1]);
+        } else {
+            numRecords = convertRows(paths[0], paths.size() == 3 ? paths[1] : "", paths.back());
+        }
+        cout << paths.back() << ": " << numRecords << " records" << endl;
+        return 0;
+    } catch (exception const & e) {
+        cerr << "Error: " << e.what() << endl;
+        return 2;
+    }
+}
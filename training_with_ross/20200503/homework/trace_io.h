@@ -0,0 +1,131 @@
+#ifndef TRACE_IO_H
+#define TRACE_IO_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Trace input shared by trace_convert.cpp and replay_trace.cpp: the reader of
+// the LeetCode-style text rows, and the fixed-width binary format.
+
+// Reads the elements of one JSON-like row ([a,b,...]) one at a time, straight
+// from the stream.
+class RowReader {
+public:
+    // Positions the reader at the beginning of the row-th line of the file.
+    RowReader(std::string const & path, int row) : _in(path), _count(0) {
+        if (!_in) {
+            throw std::runtime_error("Cannot open " + path);
+        }
+        for (int i = 0; i < row; ++i) {
+            _in.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+        _expect('[');
+        _done = _peek() == ']';
+    }
+
+    // Reads the next element as raw text (without quotes), e.g. "put", "null",
+    // "42", or "[1,2]" for nested lists. Returns false at the end of the row.
+    bool next(std::string& element) {
+        if (_done) {
+            return false;
+        }
+        element.clear();
+        int depth = 0;
+        while (true) {
+            int c = _in.get();
+            if (c == EOF) {
+                throw std::runtime_error("Row ended unexpectedly after " + std::to_string(_count) + " elements");
+            }
+            if (c == '[') {
+                ++depth;
+            } else if (c == ']') {
+                if (depth == 0) {
+                    _done = true;
+                    break;
+                }
+                --depth;
+            } else if (c == ',' && depth == 0) {
+                break;
+            }
+            if (c != '"' && c != ' ' && c != '\n' && c != '\r') {
+                element.push_back(static_cast<char>(c));
+            }
+        }
+        ++_count;
+        return true;
+    }
+
+    // Parses the arguments of an operation: "[1,2]" -> {1, 2}.
+    template <typename T>
+    static void parseArgs(std::string const & element, std::vector<T>& args) {
+        args.clear();
+        char const * p = element.c_str();
+        while (*p != '\0') {
+            if (*p == '-' || (*p >= '0' && *p <= '9')) {
+                char* end;
+                args.push_back(static_cast<T>(strtoll(p, &end, 10)));
+                p = end;
+            } else {
+                ++p;
+            }
+        }
+    }
+
+private:
+    int _peek() {
+        while (_in.peek() == ' ' || _in.peek() == '\n' || _in.peek() == '\r') {
+            _in.get();
+        }
+        return _in.peek();
+    }
+
+    void _expect(char c) {
+        if (_peek() != c) {
+            throw std::runtime_error(std::string("Expected '") + c + "' at the start of a row");
+        }
+        _in.get();
+    }
+
+    std::ifstream _in;
+    long long _count;
+    bool _done;
+};
+
+// Binary format (little-endian, as written by the host):
+//   header, 32 bytes: char magic[8] = "CTRACE01"; uint32 flags; uint32 unused;
+//                     int64 capacity; uint64 numRecords
+//   record, 16 bytes: uint8 op; uint8 unused[3]; int32 value; int64 key
+// op is GET, PUT or ACCESS (get, and put of the key on a miss). The record
+// fields are ordered so that every field is naturally aligned.
+struct TraceHeader {
+    char magic[8];
+    uint32_t flags;
+    uint32_t unused;
+    int64_t capacity;
+    uint64_t numRecords;
+};
+
+struct TraceRecord {
+    uint8_t op;
+    uint8_t unused[3];
+    int32_t value;
+    int64_t key;
+};
+
+static_assert(sizeof(TraceHeader) == 32, "TraceHeader must be 32 bytes");
+static_assert(sizeof(TraceRecord) == 16, "TraceRecord must be 16 bytes");
+
+static char const TRACE_MAGIC[8] = {'C', 'T', 'R', 'A', 'C', 'E', '0', '1'};
+
+enum TraceOp : uint8_t { OP_GET = 1, OP_PUT = 2, OP_ACCESS = 3 };
+
+// The values of the get records are the expected outputs.
+static const uint32_t FLAG_HAS_EXPECTED = 1;
+
+#endif
@@ -1,23 +1,89 @@
 #include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
 #include <vector>
-#include <list>
-#include <map>
-#include <queue>
+#include <functional>
 #include <utility>
 #include <string>
 #include <iostream>
-#include <tuple>
+#include <fstream>
+#include <cstdlib>
+#include <memory>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86_KERNELS 1
+#else
+#define HAVE_X86_KERNELS 0
+#endif
 
 using namespace std;
 
+// Allocations made by the scratch vectors of Solution, so that main() can check
+// that repeated calls do not allocate.
+static long long numAllocations = 0;
+
+// std::allocator that counts its allocations in numAllocations.
+template <typename T>
+struct CountingAllocator {
+  typedef T value_type;
+
+  CountingAllocator() {}
+
+  template <typename U>
+  CountingAllocator(CountingAllocator<U> const &) {}
+
+  T* allocate(size_t n) {
+    ++numAllocations;
+    return allocator<T>().allocate(n);
+  }
+
+  void deallocate(T* p, size_t n) {
+    allocator<T>().deallocate(p, n);
+  }
+};
+
+template <typename T, typename U>
+bool operator==(CountingAllocator<T> const &, CountingAllocator<U> const &) {
+  return true;
+}
+
+template <typename T, typename U>
+bool operator!=(CountingAllocator<T> const &, CountingAllocator<U> const &) {
+  return false;
+}
+
+template <typename T>
+using ScratchVector = vector<T, CountingAllocator<T>>;
+
+// Resident set size of the process, in KiB.
+long residentKiB() {
+  long pages = 0;
+  long resident = 0;
+  ifstream statm("/proc/self/statm");
+  statm >> pages >> resident;
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+// Set to 1 to trace every step of the simulation.
+#define DEBUG 0
+
+// A glass this close to the brim counts as full: the time to fill it is
+// computed from its level, and the rounding may leave a tiny gap.
+static const double FULL_EPS = 1e-12;
+
 struct Glass {
   // Glass() : row(-1), pos(-1), flow(0), level(0.0) {}
-  Glass(int row_, int pos_) : row(row_), pos(pos_), flow(0.0), level(0.0) {}
+  Glass(int row_, int pos_) : row(row_), pos(pos_), flow(0.0), level(0.0), newFlow(0.0) {}
   
   int row;
   int pos;
   double flow;
   double level;
+  // Flow received during the current event, not yet added to flow.
+  double newFlow;
   
   // bool operator<(Glass const & otherGlass) const {
   //   return level < otherGlass.level;
@@ -32,170 +98,782 @@ struct Glass {
   }
 };
 
+// Row overflow kernels. Each turns row r of the tower into row r + 1, in place:
+// whatever a glass holds above 1 goes half into each of the two glasses below, so
+//   next[pos] = excess(row[pos]) + excess(row[pos - 1]),  excess(x) = max(x - 1, 0) / 2
+// for pos in [0, r + 1]. row points to glass 0 and row[-1] must be 0 (a sentinel
+// for the missing left parent of glass 0); row[r + 1] is overwritten.
+//
+// They go from right to left: a write at pos only clobbers values that the
+// glasses on its left do not read, so a whole vector of glasses can be loaded,
+// combined with the same vector shifted by one, and stored back. All the
+// kernels do the same operations in the same order, and give the same bits.
+typedef void (*OverflowKernel)(double* row, int r);
+
+void overflowRowScalar(double* row, int r) {
+  row[r + 1] = 0.0;
+  for (int pos = r + 1; pos >= 0; --pos) {
+    row[pos] = max(row[pos] - 1.0, 0.0) * 0.5 + max(row[pos - 1] - 1.0, 0.0) * 0.5;
+  }
+}
+
+#if HAVE_X86_KERNELS
+__attribute__((target("sse2")))
+void overflowRowSSE2(double* row, int r) {
+  row[r + 1] = 0.0;
+  __m128d one = _mm_set1_pd(1.0);
+  __m128d half = _mm_set1_pd(0.5);
+  __m128d zero = _mm_setzero_pd();
+  int pos = r + 1;
+  for (; pos >= 1; pos -= 2) {
+    __m128d self = _mm_loadu_pd(row + pos - 1);
+    __m128d left = _mm_loadu_pd(row + pos - 2);
+    self = _mm_mul_pd(_mm_max_pd(_mm_sub_pd(self, one), zero), half);
+    left = _mm_mul_pd(_mm_max_pd(_mm_sub_pd(left, one), zero), half);
+    _mm_storeu_pd(row + pos - 1, _mm_add_pd(self, left));
+  }
+  for (; pos >= 0; --pos) {
+    row[pos] = max(row[pos] - 1.0, 0.0) * 0.5 + max(row[pos - 1] - 1.0, 0.0) * 0.5;
+  }
+}
+
+__attribute__((target("avx2")))
+void overflowRowAVX2(double* row, int r) {
+  row[r + 1] = 0.0;
+  __m256d one = _mm256_set1_pd(1.0);
+  __m256d half = _mm256_set1_pd(0.5);
+  __m256d zero = _mm256_setzero_pd();
+  int pos = r + 1;
+  for (; pos >= 3; pos -= 4) {
+    __m256d self = _mm256_loadu_pd(row + pos - 3);
+    __m256d left = _mm256_loadu_pd(row + pos - 4);
+    self = _mm256_mul_pd(_mm256_max_pd(_mm256_sub_pd(self, one), zero), half);
+    left = _mm256_mul_pd(_mm256_max_pd(_mm256_sub_pd(left, one), zero), half);
+    _mm256_storeu_pd(row + pos - 3, _mm256_add_pd(self, left));
+  }
+  for (; pos >= 0; --pos) {
+    row[pos] = max(row[pos] - 1.0, 0.0) * 0.5 + max(row[pos - 1] - 1.0, 0.0) * 0.5;
+  }
+}
+#endif
+
+// The widest kernel the CPU supports, checked at run time: the binary does not
+// need to be built for AVX2 to use it, nor to run where it is missing.
+OverflowKernel bestOverflowKernel() {
+#if HAVE_X86_KERNELS
+  if (__builtin_cpu_supports("avx2")) {
+    return overflowRowAVX2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return overflowRowSSE2;
+  }
+#endif
+  return overflowRowScalar;
+}
+
+// Range overflow kernels, for ChampagneTower: the same operations as the row
+// kernels, but from the row above into a separate row, and only over a range:
+//   row[pos] = excess(above[pos]) + excess(above[pos - 1])
+// for pos in [lo, hi]. above[lo - 1] to above[hi] must be readable (0 where the
+// glass does not exist). The rows do not overlap, so they go left to right.
+typedef void (*OverflowRangeKernel)(double const * above, double* row, int lo, int hi);
+
+void overflowRangeScalar(double const * above, double* row, int lo, int hi) {
+  for (int pos = lo; pos <= hi; ++pos) {
+    row[pos] = max(above[pos] - 1.0, 0.0) * 0.5 + max(above[pos - 1] - 1.0, 0.0) * 0.5;
+  }
+}
+
+#if HAVE_X86_KERNELS
+__attribute__((target("sse2")))
+void overflowRangeSSE2(double const * above, double* row, int lo, int hi) {
+  __m128d one = _mm_set1_pd(1.0);
+  __m128d half = _mm_set1_pd(0.5);
+  __m128d zero = _mm_setzero_pd();
+  int pos = lo;
+  for (; pos + 1 <= hi; pos += 2) {
+    __m128d self = _mm_loadu_pd(above + pos);
+    __m128d left = _mm_loadu_pd(above + pos - 1);
+    self = _mm_mul_pd(_mm_max_pd(_mm_sub_pd(self, one), zero), half);
+    left = _mm_mul_pd(_mm_max_pd(_mm_sub_pd(left, one), zero), half);
+    _mm_storeu_pd(row + pos, _mm_add_pd(self, left));
+  }
+  for (; pos <= hi; ++pos) {
+    row[pos] = max(above[pos] - 1.0, 0.0) * 0.5 + max(above[pos - 1] - 1.0, 0.0) * 0.5;
+  }
+}
+
+__attribute__((target("avx2")))
+void overflowRangeAVX2(double const * above, double* row, int lo, int hi) {
+  __m256d one = _mm256_set1_pd(1.0);
+  __m256d half = _mm256_set1_pd(0.5);
+  __m256d zero = _mm256_setzero_pd();
+  int pos = lo;
+  for (; pos + 3 <= hi; pos += 4) {
+    __m256d self = _mm256_loadu_pd(above + pos);
+    __m256d left = _mm256_loadu_pd(above + pos - 1);
+    self = _mm256_mul_pd(_mm256_max_pd(_mm256_sub_pd(self, one), zero), half);
+    left = _mm256_mul_pd(_mm256_max_pd(_mm256_sub_pd(left, one), zero), half);
+    _mm256_storeu_pd(row + pos, _mm256_add_pd(self, left));
+  }
+  for (; pos <= hi; ++pos) {
+    row[pos] = max(above[pos] - 1.0, 0.0) * 0.5 + max(above[pos - 1] - 1.0, 0.0) * 0.5;
+  }
+}
+#endif
+
+OverflowRangeKernel bestOverflowRangeKernel() {
+#if HAVE_X86_KERNELS
+  if (__builtin_cpu_supports("avx2")) {
+    return overflowRangeAVX2;
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    return overflowRangeSSE2;
+  }
+#endif
+  return overflowRangeScalar;
+}
+
 class Solution {
 public:
   double champagneTower(int poured, int query_row, int query_glass) {
-    if (poured == 0) {
+    if (poured == 0 || query_glass < 0 || query_glass > query_row) {
       return 0.0;
     }
-    
-    Glass* firstGlass = new Glass(0, 0);
-    firstGlass->flow = 1.0;
-    
-    map<pair<int, int>, Glass*> allGlasses;
-    allGlasses[make_pair(0, 0)] = firstGlass;
+
+    // Nothing flows back up: the rows below the query never matter.
+    _sim.reset(query_row);
+    ScratchVector<Glass>& glasses = _sim.glasses;
+    glasses[0].flow = 1.0;
 
     auto cmp = [](Glass* g1, Glass* g2) {
         // The glass with top priority is the next one to fill up.
         // If the glass is empty up to "level" and receives champagne with
         // flow "flow", it will take level/flow seconds to fill up.
-        // The glass with lowest time has the top priority. Since priority
-        // queues assign the highest priority to high values, we invert the
-        // relationship.
+        // The glass with lowest time has the top priority. Since heaps assign
+        // the highest priority to high values, we invert the relationship.
         return (1.0 - g1->level) / g1->flow > (1.0 - g2->level) / g2->flow;
     };
-    priority_queue<Glass*, vector<Glass*>, decltype(cmp)> pq1(cmp);
-    priority_queue<Glass*, vector<Glass*>, decltype(cmp)> pq2(cmp);
-    vector<priority_queue<Glass*, vector<Glass*>, decltype(cmp)>> pqs{pq1, pq2};
-    pqs[0].push(firstGlass);
+    // Two heaps of the glasses that are being filled.
+    ScratchVector<Glass*>* pqs = _sim.queues;
+    pqs[0].push_back(&glasses[0]);
 
-    // int numFlows = 1;
     int fromPq = 0;
     int toPq = 1;
+
+    // Glasses that are not full yet. They go back into the other heap only
+    // after their flows are updated: the priority of a glass in a heap must
+    // not change.
+    ScratchVector<Glass*>& notFull = _sim.notFull;
+
+    // Glasses with new flow to take (in Glass::newFlow), as a min-heap of
+    // indices: a glass is updated once per event, after all its parents (which
+    // have lower indices), and if it is already full the flow goes straight
+    // through to its children.
+    ScratchVector<int>& addFlowTo = _sim.addFlowTo;
+    auto sendFlow = [&](Glass const & from, double f) {
+      if (from.row == query_row) {
+        return;
+      }
+      int left = SimulationArena::index(from.row + 1, from.pos);
+      for (int child : {left, left + 1}) {
+        if (glasses[child].newFlow == 0.0) {
+          addFlowTo.push_back(child);
+          push_heap(addFlowTo.begin(), addFlowTo.end(), greater<int>());
+        }
+        glasses[child].newFlow += f;
+      }
+    };
     
     for (int afterPoured = 1; afterPoured <= poured; ++afterPoured) {
       // Assume we pour 1 glass in 1 second.
       double remainingTime = 1.0;
       
-      // DEBUG
-      cout << "Start to pour glass " << afterPoured << endl;
+      if (DEBUG) {
+        cout << "Start to pour glass " << afterPoured << endl;
+      }
 
       while (remainingTime > 0.0) {
-        priority_queue<Glass*, vector<Glass*>, decltype(cmp)>& pq = pqs[fromPq];
+        ScratchVector<Glass*>& pq = pqs[fromPq];
+        if (pq.empty()) {
+          // Every glass down to the query row is full.
+          break;
+        }
         
         // The "front" glass is the one that will fill up first.
-        double timeToNextFull = (1.0 - pq.top()->level) / pq.top()->flow;
+        double timeToNextFull = (1.0 - pq.front()->level) / pq.front()->flow;
         double pouringTime = min(remainingTime, timeToNextFull);
         remainingTime -= pouringTime;
         
-        // DEBUG
-        cout << "Next to fill: " << pq.top()->toString() << endl;
-        cout << " timeToNextFull: " << timeToNextFull << endl;
-        cout << " remainingTime:  " << remainingTime << endl;
-        cout << " pouringTime:    " << pouringTime << endl;
-        
-        // List of glasses that will have more flows at the next iteration.
-        list<tuple<int, int, double>> addFlowTo;
+        if (DEBUG) {
+          cout << "Next to fill: " << pq.front()->toString() << endl;
+          cout << " timeToNextFull: " << timeToNextFull << endl;
+          cout << " remainingTime:  " << remainingTime << endl;
+          cout << " pouringTime:    " << pouringTime << endl;
+        }
 
-        // Update all the glasses transferring them from one queue to the other.
+        // Update all the glasses.
         // Note that no glass can overflow, for how we chose the flow to pour.
-        while (!pq.empty()) {
-          Glass* glass = pq.top();
-          pq.pop();
-          
-          // DEBUG
-          cout << " -> pour into " << glass->toString() << endl;
+        for (Glass* glass : pq) {
+          if (DEBUG) {
+            cout << " -> pour into " << glass->toString() << endl;
+          }
           
           // Pour into the glass.
           glass->level += pouringTime * glass->flow;
-          if (glass->level < 1.0) {
-            // Not full yet: just insert it into the other queue.
-            pqs[toPq].push(glass);
+          if (glass->level < 1.0 - FULL_EPS) {
+            // Not full yet.
+            notFull.push_back(glass);
             
-            // DEBUG
-            cout << "    not full" << endl;
+            if (DEBUG) {
+              cout << "    not full" << endl;
+            }
           } else {
-            // This glass is full (set to 1 to overcome precision issues).
+            // This glass is full (set to 1 to overcome precision issues), and
+            // pours into its children.
             glass->level = 1.0;
-
-            if (glass->row == 99 && glass->pos == 99) {
-                cout << "=====================================" << endl;
-                cout << afterPoured << endl;
-                return 0.0;
-            }
-            
-            // What children will this glass pour into?
-            int childrenRow = glass->row + 1;
-            int leftChildPos = glass->pos;
-            int rightChildPos = glass->pos + 1;
-            
-            addFlowTo.push_back(make_tuple(childrenRow, leftChildPos, glass->flow / 2));
-            addFlowTo.push_back(make_tuple(childrenRow, rightChildPos, glass->flow / 2));
+            sendFlow(*glass, glass->flow / 2);
             
-            // Update the total amount of flow:
-            // numFlows += (- glass->flows + 2);
-            
-            // DEBUG
-            cout << "    full" << endl;
-            cout << "    left child:  (" << childrenRow << ", " << leftChildPos << ") will receive " << glass->flow / 2 << endl;
-            cout << "    right child: (" << childrenRow << ", " << rightChildPos << ") will receive " << glass->flow / 2 << endl;
-            // cout << "    numFlows: " << numFlows << endl;
+            if (DEBUG) {
+              cout << "    full, children receive " << glass->flow / 2 << endl;
+            }
           }
-        } // empty fromPQ
+        }
+        pq.clear();
                   
-        // DEBUG
-        cout << " Add children" << endl;
+        if (DEBUG) {
+          cout << " Add children" << endl;
+        }
 
         // Add the flows to the glasses that will start receiving from next round.
-        for (list<tuple<int, int, double>>::iterator aftIt = addFlowTo.begin();
-             aftIt != addFlowTo.end();
-             ++aftIt) {
-          int r = get<0>(*aftIt);
-          int p = get<1>(*aftIt);
-          double f = get<2>(*aftIt);
-
-          // DEBUG
-          cout << " - child (" << r << ", " << p << ", " << f << ")";
-
-          Glass* child;
-          map<pair<int, int>, Glass*>::iterator mIt = allGlasses.find(make_pair(r, p));
-          if (mIt != allGlasses.end()) {
-            // This glass already exists: update it.
-            child = mIt->second;
-
-            // DEBUG
-            cout << " exists";
-          } else {
-            // New glass: it is empty and is not in the queue.
-            child = new Glass(r, p);
-            allGlasses[make_pair(r, p)] = child;
-            pqs[toPq].push(child);
+        while (!addFlowTo.empty()) {
+          pop_heap(addFlowTo.begin(), addFlowTo.end(), greater<int>());
+          Glass& child = glasses[addFlowTo.back()];
+          addFlowTo.pop_back();
+          double f = child.newFlow;
+          child.newFlow = 0.0;
 
-            // DEBUG
-            cout << " new";
+          if (DEBUG) {
+            cout << " - child " << child.toString() << " receives " << f << endl;
           }
-          child->flow += f;
 
-          // DEBUG
-          cout << endl;
+          if (child.flow == 0.0) {
+            // New glass: it is empty and is not in a heap.
+            notFull.push_back(&child);
+          }
+          child.flow += f;
+          if (child.level == 1.0) {
+            sendFlow(child, f / 2);
+          }
         }
-        
-        // DEBUG
-        cout << "pqs[0].size() = " << pqs[0].size() << endl;
-        cout << "pqs[1].size() = " << pqs[1].size() << endl;
 
+        ScratchVector<Glass*>& next = pqs[toPq];
+        next.insert(next.end(), notFull.begin(), notFull.end());
+        make_heap(next.begin(), next.end(), cmp);
+        notFull.clear();
+        
+        if (DEBUG) {
+          cout << "pqs[0].size() = " << pqs[0].size() << endl;
+          cout << "pqs[1].size() = " << pqs[1].size() << endl;
+        }
 
         // Swap queues.
         fromPq = 1 - fromPq;
         toPq = 1 - toPq;
         
-        // DEBUG
-        cout << endl;
+        if (DEBUG) {
+          cout << endl;
+        }
       } // while pouringTime
     }
     
-    map<pair<int, int>, Glass*>::iterator iit = allGlasses.find(make_pair(query_row, query_glass));
-    if (iit != allGlasses.end()) {
-      return iit->second->level;
+    return glasses[SimulationArena::index(query_row, query_glass)].level;
+  }
+
+  // Second engine, with the same result. Rather than following the champagne
+  // over time, it pushes the whole poured amount down the tower one row at a
+  // time: whatever a glass holds above 1 overflows, half into each of the two
+  // glasses below. Only the current row is kept, in one buffer reused across
+  // calls and updated in place by the overflow kernel, so the cost is
+  // O(query_row^2) however much is poured.
+  double champagneTowerRows(int poured, int query_row, int query_glass) {
+    if (query_glass < 0 || query_glass > query_row) {
+      return 0.0;
+    }
+
+    _resetRow(poured, query_row);
+    for (int r = 0; r < query_row; ++r) {
+      _overflow(&_row[1], r);
     }
-    return 0.0;
+    return min(_row[query_glass + 1], 1.0);
   }
+
+  // Levels of many glasses for the same amount poured, in the order of the
+  // queries. The tower is computed once, with the rolling row, down to the
+  // deepest query: each row is read as soon as it is complete, before it
+  // overflows into the next. Glasses that do not exist are 0, like in
+  // champagneTowerRows.
+  vector<double> champagneTowerBatch(int poured, vector<pair<int, int>> const & queries) {
+    vector<double> levels(queries.size(), 0.0);
+
+    // Indices of the valid queries, by row.
+    vector<int> order;
+    order.reserve(queries.size());
+    for (size_t i = 0; i < queries.size(); ++i) {
+      if (queries[i].second >= 0 && queries[i].second <= queries[i].first) {
+        order.push_back(i);
+      }
+    }
+    if (order.empty()) {
+      return levels;
+    }
+    sort(order.begin(), order.end(), [&queries](int i, int j) {
+        return queries[i].first < queries[j].first;
+    });
+
+    int deepestRow = queries[order.back()].first;
+    _resetRow(poured, deepestRow);
+    vector<int>::iterator next = order.begin();
+    for (int r = 0; ; ++r) {
+      for (; next != order.end() && queries[*next].first == r; ++next) {
+        levels[*next] = min(_row[queries[*next].second + 1], 1.0);
+      }
+      if (r == deepestRow) {
+        break;
+      }
+      _overflow(&_row[1], r);
+    }
+    return levels;
+  }
+
+private:
+  // Row 0 of a tower of maxRow + 1 rows: glass pos is _row[pos + 1], and _row[0]
+  // is the zero sentinel the kernels read for the left parent of glass 0.
+  void _resetRow(int poured, int maxRow) {
+    _row.assign(maxRow + 2, 0.0);
+    _row[1] = poured;
+  }
+
+  // State and scratch space of champagneTower. Its vectors are cleared at every
+  // call but keep their capacity, so once they have grown to the deepest query,
+  // calls no longer allocate.
+  struct SimulationArena {
+    // Dense triangular store: glass (row, pos) is glasses[index(row, pos)].
+    ScratchVector<Glass> glasses;
+    ScratchVector<Glass*> queues[2];
+    ScratchVector<Glass*> notFull;
+    ScratchVector<int> addFlowTo;
+
+    static int index(int row, int pos) {
+      return row * (row + 1) / 2 + pos;
+    }
+
+    // An empty tower of rows 0 to maxRow.
+    void reset(int maxRow) {
+      glasses.clear();
+      glasses.reserve(index(maxRow + 1, 0));
+      for (int row = 0; row <= maxRow; ++row) {
+        for (int pos = 0; pos <= row; ++pos) {
+          glasses.emplace_back(row, pos);
+        }
+      }
+      queues[0].clear();
+      queues[1].clear();
+      notFull.clear();
+      addFlowTo.clear();
+    }
+  };
+
+  OverflowKernel _overflow = bestOverflowKernel();
+  ScratchVector<double> _row;
+  SimulationArena _sim;
+};
+
+// Tower that keeps its state between pours: pour() continues from what is
+// already in the glasses, and level() reads a glass in O(1).
+//
+// It keeps the total inflow of every glass (what has reached it so far, full or
+// not). The inflow of a row only depends on the excess of the row above, so
+// pouring more recomputes each row from the one above, with the range overflow
+// kernel, over the glasses whose parents overflow: in each row, the glasses at
+// the ends of the range that are not full send nothing, before or after the
+// pour, and are dropped from the range. A small pour into a tower with room at
+// the top touches a few glasses, not the whole tower, and a pour that reaches
+// every glass does the work of a rebuild, with the same operations and the
+// same bits. Champagne that overflows the last row is lost.
+class ChampagneTower {
+public:
+  ChampagneTower(int numRows)
+      : glassesUpdated(0), _numRows(numRows), _poured(0.0), _inflow(_index(numRows, 0), 0.0) {}
+
+  void pour(double amount) {
+    if (amount <= 0.0 || _numRows == 0) {
+      return;
+    }
+    _poured += amount;
+    _inflow[_index(0, 0)] = _poured;
+    ++glassesUpdated;
+
+    // [lo, hi]: the glasses of row r whose inflow may have changed.
+    int lo = 0;
+    int hi = 0;
+    for (int r = 0; r + 1 < _numRows; ++r) {
+      double const * above = &_inflow[_index(r, 0)];
+      while (lo <= hi && above[lo] <= 1.0) {
+        ++lo;
+      }
+      while (hi >= lo && above[hi] <= 1.0) {
+        --hi;
+      }
+      if (lo > hi) {
+        break;
+      }
+      // Their children, in row r + 1.
+      ++hi;
+      _overflowRange(above, &_inflow[_index(r + 1, 0)], lo, hi);
+      glassesUpdated += hi - lo + 1;
+    }
+  }
+
+  double level(int row, int glass) const {
+    if (row < 0 || row >= _numRows || glass < 0 || glass > row) {
+      return 0.0;
+    }
+    return min(_inflow[_index(row, glass)], 1.0);
+  }
+
+  double poured() const {
+    return _poured;
+  }
+
+  // Glasses written by all the pours so far.
+  long long glassesUpdated;
+
+private:
+  // Each row is preceded by a zero, which the kernels read as the missing left
+  // parent of its glass 0, and as the missing right parent of the last glass of
+  // the row below.
+  static int _index(int row, int pos) {
+    return row * (row + 1) / 2 + row + 1 + pos;
+  }
+
+  int _numRows;
+  double _poured;
+
+  // Glass (row, pos) is _inflow[_index(row, pos)].
+  vector<double> _inflow;
+  OverflowRangeKernel _overflowRange = bestOverflowRangeKernel();
 };
 
 int main() {
     Solution* sol = new Solution(); 
-    double res = sol->champagneTower(1000000000, 3, 0);
+    double res = sol->champagneTowerRows(1000000000, 3, 0);
     cout << "res " << res << endl;
+    assert(res == 1.0);
+
+    // LeetCode examples.
+    assert(sol->champagneTowerRows(1, 1, 1) == 0.0);
+    assert(sol->champagneTowerRows(2, 1, 1) == 0.5);
+    assert(abs(sol->champagneTowerRows(100000009, 33, 17) - 1.0) < 1e-9);
+
+    // The two engines agree on every glass of the first rows.
+    for (int poured : {0, 1, 2, 3, 4, 5, 7, 10, 16, 25, 50, 100}) {
+      for (int r = 0; r < 16; ++r) {
+        for (int g = 0; g <= r; ++g) {
+          double simulated = sol->champagneTower(poured, r, g);
+          double rows = sol->champagneTowerRows(poured, r, g);
+          if (abs(simulated - rows) > 1e-9) {
+            cout << "poured " << poured << ", glass (" << r << ", " << g << "): "
+                 << simulated << " vs " << rows << endl;
+            assert(false);
+          }
+        }
+      }
+    }
+    cout << "The simulator and the rolling row agree to 1e-9." << endl << endl;
+
+    cout << "Benchmark (query glass (99, 50)), us/call:" << endl;
+    cout << "poured       simulator    rolling row" << endl;
+    double checksum = 0.0;
+    for (int poured : {10, 100, 1000, 10000, 1000000, 1000000000}) {
+      cout << poured << "\t     ";
+      if (poured <= 1000000) {
+        int calls = max(1, 10000 / poured);
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < calls; ++i) {
+          checksum += sol->champagneTower(poured, 99, 50);
+        }
+        auto end = chrono::steady_clock::now();
+        cout << chrono::duration<double, micro>(end - start).count() / calls;
+      } else {
+        // Grows with poured: 10^9 glasses would take about an hour.
+        cout << "-";
+      }
+
+      int calls = 10000;
+      auto start = chrono::steady_clock::now();
+      for (int i = 0; i < calls; ++i) {
+        checksum += sol->champagneTowerRows(poured, 99, 50);
+      }
+      auto end = chrono::steady_clock::now();
+      cout << "\t  " << chrono::duration<double, micro>(end - start).count() / calls << endl;
+    }
+    cout << endl;
+
+    // Batch queries: the same levels as one call per query, computed once.
+    vector<pair<int, int>> queries;
+    unsigned int seed = 1;
+    for (int i = 0; i < 1000; ++i) {
+      seed = seed * 1103515245u + 12345u;
+      int r = (seed >> 8) % 100;
+      seed = seed * 1103515245u + 12345u;
+      queries.push_back(make_pair(r, (seed >> 8) % (r + 1)));
+    }
+    queries.push_back(make_pair(3, 4));
+    queries.push_back(make_pair(-1, 0));
+    vector<double> batch = sol->champagneTowerBatch(1000, queries);
+    for (size_t i = 0; i < queries.size(); ++i) {
+      assert(batch[i] == sol->champagneTowerRows(1000, queries[i].first, queries[i].second));
+    }
+    assert(sol->champagneTowerBatch(1000, {}).empty());
+    cout << "The batch matches one call per query." << endl << endl;
+    queries.resize(1000);
+
+    cout << "Benchmark (1000 queries, rows 0-99), us per batch:" << endl;
+    cout << "poured       simulator/query   rolling row/query   batch" << endl;
+    for (int poured : {100, 1000000000}) {
+      cout << poured << "\t     ";
+      auto start = chrono::steady_clock::now();
+      if (poured <= 100) {
+        for (pair<int, int> const & q : queries) {
+          checksum += sol->champagneTower(poured, q.first, q.second);
+        }
+        cout << chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+      } else {
+        cout << "-";
+      }
+
+      int calls = 100;
+      start = chrono::steady_clock::now();
+      for (int i = 0; i < calls; ++i) {
+        for (pair<int, int> const & q : queries) {
+          checksum += sol->champagneTowerRows(poured, q.first, q.second);
+        }
+      }
+      cout << "\t\t  " << chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / calls;
+
+      calls = 10000;
+      start = chrono::steady_clock::now();
+      for (int i = 0; i < calls; ++i) {
+        checksum += sol->champagneTowerBatch(poured, queries)[0];
+      }
+      cout << "\t      " << chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / calls << endl;
+    }
+    cout << endl;
+
+    // 1M calls of each engine on the same Solution: once the scratch space has
+    // grown to the deepest query, no call allocates, and the RSS stays flat.
+    cout << "RSS over 1M calls (poured 0-49, rows 0-19):" << endl;
+    cout << "calls      RSS (KiB)   allocations" << endl;
+    sol->champagneTower(49, 19, 0);
+    sol->champagneTowerRows(49, 19, 0);
+    assert(numAllocations > 0);
+    long long callAllocations = 0;
+    for (int i = 0; i <= 1000000; ++i) {
+      if (i % 100000 == 0) {
+        cout << i << "\t   " << residentKiB() << "\t       " << callAllocations << endl;
+      }
+      int poured = i % 50;
+      int r = i % 20;
+      int g = (i / 20) % (r + 1);
+      long long allocsBefore = numAllocations;
+      checksum += sol->champagneTower(poured, r, g);
+      checksum += sol->champagneTowerRows(poured, r, g);
+      callAllocations += numAllocations - allocsBefore;
+    }
+    assert(callAllocations == 0);
+    cout << endl;
+
+    // All the kernels give the same bits, on every row length (the vector loops
+    // have scalar tails).
+    vector<pair<string, OverflowKernel>> kernels{make_pair("scalar", overflowRowScalar)};
+#if HAVE_X86_KERNELS
+    if (__builtin_cpu_supports("sse2")) {
+      kernels.push_back(make_pair("SSE2", overflowRowSSE2));
+    }
+    if (__builtin_cpu_supports("avx2")) {
+      kernels.push_back(make_pair("AVX2", overflowRowAVX2));
+    }
+#endif
+    for (int numRows : {1, 2, 3, 4, 5, 6, 7, 8, 9, 100}) {
+      vector<vector<double>> rows;
+      for (pair<string, OverflowKernel> const & k : kernels) {
+        vector<double> row(numRows + 1, 0.0);
+        row[1] = 1000.0;
+        for (int r = 0; r + 1 < numRows; ++r) {
+          k.second(&row[1], r);
+        }
+        rows.push_back(row);
+      }
+      for (vector<double> const & row : rows) {
+        assert(row == rows[0]);
+      }
+    }
+    cout << "Kernels:";
+    for (pair<string, OverflowKernel> const & k : kernels) {
+      cout << " " << k.first << (k.second == bestOverflowKernel() ? " (selected)" : "");
+    }
+    cout << ", all bit-identical." << endl << endl;
+
+    // Same for the range kernels, on every range of a row of 12 glasses (with
+    // zeros around it, as in ChampagneTower).
+    vector<pair<string, OverflowRangeKernel>> rangeKernels{make_pair("scalar", overflowRangeScalar)};
+#if HAVE_X86_KERNELS
+    if (__builtin_cpu_supports("sse2")) {
+      rangeKernels.push_back(make_pair("SSE2", overflowRangeSSE2));
+    }
+    if (__builtin_cpu_supports("avx2")) {
+      rangeKernels.push_back(make_pair("AVX2", overflowRangeAVX2));
+    }
+#endif
+    {
+      vector<double> above(14, 0.0);
+      for (int pos = 0; pos < 12; ++pos) {
+        above[pos + 1] = (pos * 7) % 5 * 0.75;
+      }
+      for (int lo = 0; lo <= 12; ++lo) {
+        for (int hi = lo; hi <= 12; ++hi) {
+          vector<vector<double>> rows;
+          for (pair<string, OverflowRangeKernel> const & k : rangeKernels) {
+            vector<double> row(13, -1.0);
+            k.second(&above[1], &row[0], lo, hi);
+            rows.push_back(row);
+          }
+          for (vector<double> const & row : rows) {
+            assert(row == rows[0]);
+          }
+        }
+      }
+    }
+    cout << "Range kernels:";
+    for (pair<string, OverflowRangeKernel> const & k : rangeKernels) {
+      cout << " " << k.first << (k.second == bestOverflowRangeKernel() ? " (selected)" : "");
+    }
+    cout << ", all bit-identical." << endl << endl;
+
+    // Incremental pours: the same levels as a tower built from scratch, to the
+    // bit when the amounts add up exactly.
+    {
+      ChampagneTower tower(100);
+      tower.pour(0.0);
+      assert(tower.level(0, 0) == 0.0);
+      tower.pour(1.0);
+      assert(tower.level(0, 0) == 1.0 && tower.level(1, 1) == 0.0);
+      tower.pour(1.0);
+      assert(tower.level(1, 0) == 0.5 && tower.level(1, 1) == 0.5);
+      assert(tower.level(100, 0) == 0.0 && tower.level(3, 4) == 0.0);
+      for (int amount : {1, 3, 10, 50, 100, 1000, 10000}) {
+        tower.pour(amount);
+        int total = static_cast<int>(tower.poured());
+        for (int r = 0; r < 100; ++r) {
+          for (int g = 0; g <= r; ++g) {
+            assert(tower.level(r, g) == sol->champagneTowerRows(total, r, g));
+          }
+        }
+      }
+      // Fractions of a glass at a time.
+      ChampagneTower drops(20);
+      for (int i = 0; i < 1000; ++i) {
+        drops.pour(0.05);
+      }
+      for (int r = 0; r < 20; ++r) {
+        for (int g = 0; g <= r; ++g) {
+          assert(abs(drops.level(r, g) - sol->champagneTowerRows(50, r, g)) < 1e-9);
+        }
+      }
+      cout << "Incremental pours match the tower built from scratch." << endl << endl;
+    }
+
+    cout << "Benchmark (10K pours of 1 glass into 100 rows, glass (99, 50) read after each):" << endl;
+    {
+      int numPours = 10000;
+      ChampagneTower tower(100);
+      auto start = chrono::steady_clock::now();
+      for (int i = 0; i < numPours; ++i) {
+        tower.pour(1.0);
+        checksum += tower.level(99, 50);
+      }
+      double incrementalUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+
+      start = chrono::steady_clock::now();
+      for (int i = 1; i <= numPours; ++i) {
+        checksum += sol->champagneTowerRows(i, 99, 50);
+      }
+      double rebuildUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+
+      cout << "  incremental:  " << incrementalUs / numPours << " us/pour, "
+           << static_cast<double>(tower.glassesUpdated) / numPours << " glasses/pour" << endl;
+      cout << "  rebuild:      " << rebuildUs / numPours << " us/pour, 5050 glasses/pour" << endl;
+
+      // Small pours into a tower that is far from full: they stop near the top.
+      ChampagneTower slow(100);
+      start = chrono::steady_clock::now();
+      for (int i = 0; i < numPours; ++i) {
+        slow.pour(0.01);
+        checksum += slow.level(99, 50);
+      }
+      cout << "  incremental, 0.01 glass/pour:  "
+           << chrono::duration<double, micro>(chrono::steady_clock::now() - start).count() / numPours << " us/pour, "
+           << static_cast<double>(slow.glassesUpdated) / numPours << " glasses/pour" << endl;
+
+      // Pours into a tower that overflows down to the last row: the widest
+      // ranges (the glasses near the edges of the deep rows never fill up).
+      ChampagneTower full(100);
+      full.pour(1000000.0);
+      long long updatedBefore = full.glassesUpdated;
+      start = chrono::steady_clock::now();
+      for (int i = 0; i < numPours; ++i) {
+        full.pour(1.0);
+        checksum += full.level(99, 50);
+      }
+      double fullUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+      start = chrono::steady_clock::now();
+      for (int i = 1; i <= numPours; ++i) {
+        checksum += sol->champagneTowerRows(1000000 + i, 99, 50);
+      }
+      double fullRebuildUs = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+      cout << "  incremental, 10^6 poured:  " << fullUs / numPours << " us/pour, "
+           << static_cast<double>(full.glassesUpdated - updatedBefore) / numPours << " glasses/pour" << endl;
+      cout << "  rebuild, 10^6 poured:      " << fullRebuildUs / numPours << " us/pour" << endl << endl;
+    }
+
+    cout << "Benchmark (whole tower, 10^9 poured), glasses/ns:" << endl;
+    cout << "rows    ";
+    for (pair<string, OverflowKernel> const & k : kernels) {
+      cout << k.first << "\t";
+    }
+    cout << endl;
+    for (int numRows : {1000, 10000, 100000}) {
+      cout << numRows << "\t";
+      double glasses = static_cast<double>(numRows) * (numRows + 1) / 2;
+      int repeats = max(1, static_cast<int>(2e8 / glasses));
+      vector<double> row(numRows + 1);
+      for (pair<string, OverflowKernel> const & k : kernels) {
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < repeats; ++i) {
+          fill(row.begin(), row.end(), 0.0);
+          row[1] = 1000000000.0;
+          for (int r = 0; r + 1 < numRows; ++r) {
+            k.second(&row[1], r);
+          }
+          checksum += row[numRows / 2];
+        }
+        auto end = chrono::steady_clock::now();
+        cout << repeats * glasses / chrono::duration<double, nano>(end - start).count() << "\t";
+      }
+      cout << endl;
+    }
+    cout << "(checksum " << checksum << ")" << endl;
+    delete sol;
     return 0;
 }
-